@@ -14,6 +14,12 @@
 
 #include <string>
 #include <cassert>
+#include <cstring>
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 /*===============================================================
  *
@@ -110,6 +116,189 @@ inline int getCharactersFromUTF8String(const std::string &s, std::vector<string>
   return len;
 }
 
+/*----------------------------------------------------------------
+ *
+ * decodeUTF8Character - decode the character starting at s[idx]
+ *                       to its code point and move idx past it.
+ *                       lengths follow getCharactersFromUTF8String.
+ *
+ *----------------------------------------------------------------*/
+
+inline unsigned int decodeUTF8Character(const std::string &s, unsigned long int &idx) {
+  unsigned char c = s[idx];
+  unsigned long int n;
+  unsigned int cp;
+  if ((c & 0x80) == 0) {
+    n = 1;
+    cp = c;
+  } else if ((c & 0xE0) == 0xC0) {
+    n = 2;
+    cp = c & 0x1F;
+  } else if ((c & 0xF0) == 0xE0) {
+    n = 3;
+    cp = c & 0x0F;
+  } else {
+    n = 4;
+    cp = c & 0x07;
+  }
+  if (s.length() - idx < n) {
+    n = s.length() - idx;
+  }
+  for (unsigned long int k = 1; k < n; k++) {
+    cp = (cp << 6) | (s[idx + k] & 0x3F);
+  }
+  idx += n;
+  return cp;
+}
+
+/*----------------------------------------------------------------
+ *
+ * getASCIIPrefixLength - how many bytes at the start of s are
+ *                        ASCII, 16 bytes are tested at a time
+ *                        with SSE2 and 8 at a time otherwise.
+ *
+ *----------------------------------------------------------------*/
+
+inline size_t getASCIIPrefixLength(const char *s, size_t n) {
+  size_t idx = 0;
+#if defined(__SSE2__)
+  for (; idx + 16 <= n; idx += 16) {
+    int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(s + idx)));
+    if (mask != 0) {
+      return idx + __builtin_ctz(mask);
+    }
+  }
+#endif
+  for (; idx + 8 <= n; idx += 8) {
+    uint64_t block;
+    std::memcpy(&block, s + idx, 8);
+    if (block & 0x8080808080808080ULL) {
+      break;
+    }
+  }
+  while (idx < n && (s[idx] & 0x80) == 0) {
+    ++idx;
+  }
+  return idx;
+}
+
+/*----------------------------------------------------------------
+ *
+ * getUTF8CharLength - bytes of the character whose lead byte is c,
+ *                     lengths follow getCharactersFromUTF8String.
+ *
+ *----------------------------------------------------------------*/
+
+inline size_t getUTF8CharLength(unsigned char c) {
+  if ((c & 0x80) == 0) {
+    return 1;
+  } else if ((c & 0xE0) == 0xC0) {
+    return 2;
+  } else if ((c & 0xF0) == 0xE0) {
+    return 3;
+  }
+  return 4;
+}
+
+/*----------------------------------------------------------------
+ *
+ * isValidUTF8 - whether s is well formed utf-8, without overlong
+ *               forms, surrogates or code points past U+10FFFF.
+ *
+ *----------------------------------------------------------------*/
+
+inline bool isValidUTF8(const char *s, size_t n) {
+  size_t idx = 0;
+  while (idx < n) {
+    idx += getASCIIPrefixLength(s + idx, n - idx);
+    if (idx >= n) {
+      break;
+    }
+    const unsigned char *u = (const unsigned char *)s + idx;
+    const size_t len = getUTF8CharLength(u[0]);
+    if (u[0] < 0xC2 || u[0] > 0xF4 || n - idx < len) {
+      return false;
+    }
+    for (size_t k = 1; k < len; k++) {
+      if ((u[k] & 0xC0) != 0x80) {
+        return false;
+      }
+    }
+    if ((u[0] == 0xE0 && u[1] < 0xA0) || (u[0] == 0xED && u[1] > 0x9F)
+        || (u[0] == 0xF0 && u[1] < 0x90) || (u[0] == 0xF4 && u[1] > 0x8F)) {
+      return false;
+    }
+    idx += len;
+  }
+  return true;
+}
+
+inline bool isValidUTF8(const std::string &s) {
+  return isValidUTF8(s.data(), s.size());
+}
+
+/*----------------------------------------------------------------
+ *
+ * UTF8Iterator - walk the characters of a utf-8 string as byte
+ *                spans [pos(), pos() + length()) of it, nothing
+ *                is copied. lengths follow getCharactersFromUTF8String,
+ *                a character cut by the end of the string is clipped.
+ *                runs of ASCII are found with getASCIIPrefixLength.
+ *
+ *----------------------------------------------------------------*/
+
+class UTF8Iterator {
+ protected:
+  const char *s_;
+  size_t size_;
+  size_t pos_;
+  // bytes before ascii_ are known to be ASCII
+  size_t ascii_;
+
+ public:
+  UTF8Iterator(const char *s, size_t n) : s_(s), size_(n), pos_(0), ascii_(getASCIIPrefixLength(s, n)) {}
+  explicit UTF8Iterator(const std::string &s) : s_(s.data()), size_(s.size()), pos_(0), ascii_(getASCIIPrefixLength(s.data(), s.size())) {}
+
+  inline bool done() const {
+    return pos_ >= size_;
+  }
+  inline size_t pos() const {
+    return pos_;
+  }
+  inline const char *data() const {
+    return s_ + pos_;
+  }
+  inline size_t length() const {
+    if (pos_ < ascii_) {
+      return 1;
+    }
+    size_t len = getUTF8CharLength(s_[pos_]);
+    return len < size_ - pos_ ? len : size_ - pos_;
+  }
+  inline void next() {
+    if (pos_ < ascii_) {
+      ++pos_;
+      return;
+    }
+    pos_ += length();
+    if (pos_ < size_ && (s_[pos_] & 0x80) == 0) {
+      ascii_ = pos_ + getASCIIPrefixLength(s_ + pos_, size_ - pos_);
+    }
+  }
+  inline unsigned int codepoint() const {
+    const size_t len = length();
+    const size_t lead = getUTF8CharLength(s_[pos_]);
+    unsigned int cp = (unsigned char)s_[pos_];
+    if (lead > 1) {
+      cp &= 0x7F >> lead;
+    }
+    for (size_t k = 1; k < len; k++) {
+      cp = (cp << 6) | (s_[pos_ + k] & 0x3F);
+    }
+    return cp;
+  }
+};
+
 /*----------------------------------------------------------------
  *
  * getFirstCharFromUTF8String - get the first character from 
@@ -25,6 +25,8 @@
 #include <iostream>
 #include <map>
 #include <algorithm>
+#include <cstring>
+#include <cstdint>
 
 #include "args.h"
 #include "dictionary.h"
@@ -45,11 +47,14 @@ class basic_quark {
   public:
     typedef unordered_map<std::string, int32_t> StringToId;
     typedef map<std::string, int32_t> StringToId_Order;
-    typedef std::vector<std::string> IdToString;
     typedef std::vector<int64_t> IdToFreq;
 
-    StringToId m_string_to_id;
-    IdToString m_id_to_string;
+    // the strings back to back, string i is [m_offsets[i], m_offsets[i + 1]) of m_arena
+    std::vector<char> m_arena;
+    std::vector<int64_t> m_offsets;
+    std::vector<uint32_t> m_hashes;
+    // open addressing on the hash, a slot holds an id or -1
+    std::vector<int32_t> m_table;
     IdToFreq   m_id_to_freq;
     int32_t m_size;
     int64_t m_max_freq;
@@ -59,6 +64,46 @@ class basic_quark {
     int32_t m_max_size;
     int32_t m_reduce_threshold;
 
+    static inline uint32_t hash(const char* str, size_t len) {
+        uint32_t h = 2166136261;
+        for (size_t i = 0; i < len; i++) {
+            h = (h ^ uint8_t(str[i])) * 16777619;
+        }
+        return h;
+    }
+
+    /**
+     * Slot of a string, the slot of its ID or the empty one ending its probe.
+     */
+    inline size_t find_slot(const char* str, size_t len, uint32_t h) const {
+        const size_t mask = m_table.size() - 1;
+        size_t slot = h & mask;
+        while (true) {
+            int32_t qid = m_table[slot];
+            if (qid < 0 || (m_hashes[qid] == h && size_t(length(qid)) == len
+                && std::memcmp(data(qid), str, len) == 0)) {
+                return slot;
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+
+    /**
+     * Double the table once it is half full.
+     */
+    void grow_table() {
+        std::vector<int32_t> table(std::max<size_t>(2 * m_table.size(), 64), -1);
+        const size_t mask = table.size() - 1;
+        for (int32_t qid = 0; qid < m_size; qid++) {
+            size_t slot = m_hashes[qid] & mask;
+            while (table[slot] >= 0) {
+                slot = (slot + 1) & mask;
+            }
+            table[slot] = qid;
+        }
+        m_table.swap(table);
+    }
+
   public:
     /**
      * Construct.
@@ -87,12 +132,10 @@ class basic_quark {
      *  @return           Associated ID for the string value.
      */
     int32_t from_string(const std::string& str) const {
-        StringToId::const_iterator it = m_string_to_id.find(str);
-        if (it != m_string_to_id.end()) {
-            return it->second;
-        } else {
+        if (m_size == 0) {
             return -1;
         }
+        return m_table[find_slot(str.data(), str.size(), hash(str.data(), str.size()))];
     }
 
 
@@ -102,14 +145,25 @@ class basic_quark {
      *  @param  def         Default value if the ID was out of range.
      *  @return           String value associated with the ID.
      */
-    const std::string& from_id(const int32_t& qid, const std::string& def = "") const {
+    std::string from_id(const int32_t& qid, const std::string& def = "") const {
         if (qid < 0 || m_size <= qid) {
             return def;
         } else {
-            return m_id_to_string[qid];
+            return std::string(data(qid), length(qid));
         }
     }
 
+    /**
+     * Bytes of the string of an ID, in the arena and not NUL terminated.
+     */
+    inline const char* data(int32_t qid) const {
+        return m_arena.data() + m_offsets[qid];
+    }
+
+    inline int32_t length(int32_t qid) const {
+        return m_offsets[qid + 1] - m_offsets[qid];
+    }
+
 
 
     /**
@@ -118,20 +172,26 @@ class basic_quark {
      *  @return           ID if any, otherwise -1.
      */
     int32_t add_string(const std::string& str, int64_t freq = 1) {
-        StringToId::const_iterator it = m_string_to_id.find(str);
-        if (it != m_string_to_id.end()) {
-            int32_t qid = it->second;
+        if (2 * (size_t(m_size) + 1) > m_table.size()) {
+            grow_table();
+        }
+        const uint32_t h = hash(str.data(), str.size());
+        const size_t slot = find_slot(str.data(), str.size(), h);
+        if (m_table[slot] >= 0) {
+            int32_t qid = m_table[slot];
             m_id_to_freq[qid] = m_id_to_freq[qid] + freq;
             if(m_id_to_freq[qid] > m_max_freq) m_max_freq = m_id_to_freq[qid];
             m_allword_count += freq;
-            return it->second;
+            return qid;
         } else {
             int32_t newid = m_size;
-            m_id_to_string.push_back(str);
+            m_arena.insert(m_arena.end(), str.begin(), str.end());
+            m_offsets.push_back(m_arena.size());
+            m_hashes.push_back(h);
             m_id_to_freq.push_back(freq);
             if(m_size == 0) m_max_freq = freq;
             m_allword_count += freq;
-            m_string_to_id.insert(std::pair<std::string, int32_t>(str, newid));
+            m_table[slot] = newid;
             m_size++;
             if (m_size >= m_max_size) {
                 reduce();
@@ -141,8 +201,10 @@ class basic_quark {
     }
 
     void clear() {
-        m_string_to_id.clear();
-        m_id_to_string.clear();
+        m_arena.clear();
+        m_offsets.assign(1, 0);
+        m_hashes.clear();
+        m_table.clear();
         m_id_to_freq.clear();
         m_size = 0;
         m_max_freq = 0;
@@ -157,6 +219,14 @@ class basic_quark {
         return m_size;
     }
 
+    /**
+     * Bytes held by the strings, the table and the frequencies.
+     */
+    int64_t memory() const {
+        return m_arena.capacity() + m_offsets.capacity() * sizeof(int64_t) + m_hashes.capacity() * sizeof(uint32_t)
+            + m_table.capacity() * sizeof(int32_t) + m_id_to_freq.capacity() * sizeof(int64_t);
+    }
+
     void prune(int threshold) {
         if (m_reduce_threshold >= threshold) {
             return;
@@ -169,11 +239,12 @@ class basic_quark {
     void reduce() {
         //std::cout << "Reaching max size, reducing low-frequency items" << std::endl;
         //std::cout << "Current Size: " << m_size << std::endl;
+        // the survivors go through a map as they always did, so their ids keep the same order
         StringToId tmp_string_to_id;
 
         for (int32_t idx = 0; idx < m_size; idx++) {
             if (m_id_to_freq[idx] < m_reduce_threshold) continue;
-            tmp_string_to_id[m_id_to_string[idx]] = m_id_to_freq[idx];
+            tmp_string_to_id[from_id(idx)] = m_id_to_freq[idx];
         }
 	
         clear();
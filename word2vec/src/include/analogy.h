@@ -0,0 +1,242 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: analogy.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: word analogy evaluation, "a b c d" questions answered by 3CosAdd and
+*            3CosMul over the normalized word vectors, questions are scored in
+*            batches against blocks of the vocabulary.
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <limits>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <unordered_map>
+#include <cmath>
+
+#include "args.h"
+#include "matrix.h"
+#include "real.h"
+
+class Analogy {
+  protected:
+	struct Question {
+		int32_t a;
+		int32_t b;
+		int32_t c;
+		int32_t d;
+		int32_t category;
+	};
+	struct Category {
+		std::string name;
+		int64_t total;
+		int64_t answered;
+		std::atomic<int64_t> add;
+		std::atomic<int64_t> mul;
+	};
+
+	std::shared_ptr<Args> args_;
+	std::vector<std::string> words_;
+	std::unordered_map<std::string, int32_t> index_;
+	// unit length word vectors
+	std::shared_ptr<Matrix> vectors_;
+	std::vector<Question> questions_;
+	std::vector<std::unique_ptr<Category> > categories_;
+
+	// questions scored together, and words of one vocabulary block
+	static const int32_t QUESTION_BLOCK = 8;
+	static const int32_t WORD_BLOCK = 512;
+
+	int32_t findWord(const std::string&) const;
+	void answer(const Question*, int32_t, std::vector<real>&);
+
+  public:
+	Analogy(std::shared_ptr<Args>, const std::vector<std::string>&, std::shared_ptr<Matrix>);
+
+	void readQuestions(std::istream&);
+	void evaluate(std::ostream&);
+};
+
+/**
+* @Function: index the words and normalize every vector once.
+*/
+Analogy::Analogy(std::shared_ptr<Args> args, const std::vector<std::string>& words,
+	std::shared_ptr<Matrix> vectors) : args_(args), words_(words), vectors_(vectors) {
+	for (size_t i = 0; i < words_.size(); i++) {
+		index_[words_[i]] = i;
+	}
+	const int64_t dim = vectors_->cols();
+	for (int64_t i = 0; i < vectors_->rows(); i++) {
+		real norm = vectors_->l2NormRow(i);
+		if (norm > 0) {
+			real* row = vectors_->data() + i * dim;
+			for (int64_t j = 0; j < dim; j++) {
+				row[j] /= norm;
+			}
+		}
+	}
+}
+
+int32_t Analogy::findWord(const std::string& word) const {
+	auto it = index_.find(word);
+	return it == index_.end() ? -1 : it->second;
+}
+
+/**
+* @Function: read questions, ": name" starts a category, questions with a word
+*            out of the vocabulary are counted but not answered.
+*/
+void Analogy::readQuestions(std::istream& in) {
+	std::string line, a, b, c, d;
+	int32_t category = -1;
+	while (std::getline(in, line)) {
+		if (line.empty()) {
+			continue;
+		}
+		if (line[0] == ':') {
+			categories_.emplace_back(new Category());
+			category = categories_.size() - 1;
+			std::stringstream name(line.substr(1));
+			name >> categories_[category]->name;
+			continue;
+		}
+		std::stringstream fields(line);
+		if (!(fields >> a >> b >> c >> d)) {
+			continue;
+		}
+		if (category < 0) {
+			categories_.emplace_back(new Category());
+			category = 0;
+			categories_[category]->name = "default";
+		}
+		Category& cat = *categories_[category];
+		cat.total++;
+		Question q = { findWord(a), findWord(b), findWord(c), findWord(d), category };
+		if (q.a < 0 || q.b < 0 || q.c < 0 || q.d < 0) {
+			continue;
+		}
+		cat.answered++;
+		questions_.push_back(q);
+	}
+}
+
+/**
+* @Function: answer n questions, the cosines of a, b and c with every word are
+*            computed block by block, 3CosAdd is cos(b) - cos(a) + cos(c) and
+*            3CosMul is cos'(b) * cos'(c) / (cos'(a) + eps) with cos' = (cos + 1) / 2.
+*/
+void Analogy::answer(const Question* questions, int32_t n, std::vector<real>& scores) {
+	const int64_t dim = vectors_->cols();
+	const int64_t nwords = vectors_->rows();
+	const real* mat = vectors_->data();
+	const real eps = 1e-3;
+	// rows 3 * q + {0, 1, 2} are the vectors of a, b and c
+	const int32_t nq = 3 * n;
+	const real* query[3 * QUESTION_BLOCK];
+	for (int32_t q = 0; q < n; q++) {
+		query[3 * q] = mat + int64_t(questions[q].a) * dim;
+		query[3 * q + 1] = mat + int64_t(questions[q].b) * dim;
+		query[3 * q + 2] = mat + int64_t(questions[q].c) * dim;
+	}
+	real bestAdd[QUESTION_BLOCK], bestMul[QUESTION_BLOCK];
+	int32_t argAdd[QUESTION_BLOCK], argMul[QUESTION_BLOCK];
+	for (int32_t q = 0; q < n; q++) {
+		bestAdd[q] = bestMul[q] = -std::numeric_limits<real>::max();
+		argAdd[q] = argMul[q] = -1;
+	}
+	scores.resize(3 * QUESTION_BLOCK * WORD_BLOCK);
+	for (int64_t w0 = 0; w0 < nwords; w0 += WORD_BLOCK) {
+		const int64_t w1 = std::min<int64_t>(nwords, w0 + WORD_BLOCK);
+		// scores[i * WORD_BLOCK + w] = <query i, word w0 + w>
+		for (int64_t w = w0; w < w1; w++) {
+			const real* row = mat + w * dim;
+			for (int32_t i = 0; i < nq; i++) {
+				const real* v = query[i];
+				real dot = 0.0;
+				for (int64_t j = 0; j < dim; j++) {
+					dot += row[j] * v[j];
+				}
+				scores[i * WORD_BLOCK + (w - w0)] = dot;
+			}
+		}
+		for (int32_t q = 0; q < n; q++) {
+			const real* ca = &scores[(3 * q) * WORD_BLOCK];
+			const real* cb = &scores[(3 * q + 1) * WORD_BLOCK];
+			const real* cc = &scores[(3 * q + 2) * WORD_BLOCK];
+			const Question& question = questions[q];
+			for (int64_t w = w0; w < w1; w++) {
+				if (w == question.a || w == question.b || w == question.c) {
+					continue;
+				}
+				const int64_t k = w - w0;
+				real add = cb[k] - ca[k] + cc[k];
+				real mul = ((cb[k] + 1) / 2) * ((cc[k] + 1) / 2) / ((ca[k] + 1) / 2 + eps);
+				if (add > bestAdd[q]) {
+					bestAdd[q] = add;
+					argAdd[q] = w;
+				}
+				if (mul > bestMul[q]) {
+					bestMul[q] = mul;
+					argMul[q] = w;
+				}
+			}
+		}
+	}
+	for (int32_t q = 0; q < n; q++) {
+		Category& cat = *categories_[questions[q].category];
+		if (argAdd[q] == questions[q].d) cat.add++;
+		if (argMul[q] == questions[q].d) cat.mul++;
+	}
+}
+
+/**
+* @Function: answer every question on -thread threads and report the accuracy
+*            of every category.
+*/
+void Analogy::evaluate(std::ostream& out) {
+	const int64_t nblocks = (questions_.size() + QUESTION_BLOCK - 1) / QUESTION_BLOCK;
+	std::atomic<int64_t> next(0);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<std::thread> threads;
+	for (int32_t t = 0; t < args_->thread; t++) {
+		threads.push_back(std::thread([&]() {
+			std::vector<real> scores;
+			for (int64_t b = next++; b < nblocks; b = next++) {
+				int64_t first = b * QUESTION_BLOCK;
+				int32_t n = std::min<int64_t>(QUESTION_BLOCK, questions_.size() - first);
+				answer(&questions_[first], n, scores);
+			}
+		}));
+	}
+	for (int32_t t = 0; t < args_->thread; t++) {
+		threads[t].join();
+	}
+	double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	int64_t total = 0, answered = 0, add = 0, mul = 0;
+	out << std::fixed << std::setprecision(2);
+	for (size_t i = 0; i < categories_.size(); i++) {
+		const Category& cat = *categories_[i];
+		out << cat.name << ": " << cat.answered << "/" << cat.total << " questions"
+			<< ", 3CosAdd " << (cat.answered > 0 ? 100.0 * cat.add / cat.answered : 0.0) << "%"
+			<< ", 3CosMul " << (cat.answered > 0 ? 100.0 * cat.mul / cat.answered : 0.0) << "%" << std::endl;
+		total += cat.total;
+		answered += cat.answered;
+		add += cat.add;
+		mul += cat.mul;
+	}
+	out << "Total: " << answered << "/" << total << " questions"
+		<< ", 3CosAdd " << (answered > 0 ? 100.0 * add / answered : 0.0) << "%"
+		<< ", 3CosMul " << (answered > 0 ? 100.0 * mul / answered : 0.0) << "%" << std::endl;
+	std::cerr << "Answered " << answered << " questions over " << words_.size() << " words in "
+		<< std::setprecision(2) << t << "s, " << int64_t(answered / std::max(t, 1e-6)) << " questions/sec" << std::endl;
+}
@@ -14,7 +14,7 @@
 
 
 enum class model_name : int { skipgram = 1, cbow, subword, substoke};
-enum class loss_name : int {ns = 1};
+enum class loss_name : int {ns = 1, hs};
 
 class Args {
 	protected:
@@ -34,6 +34,7 @@ class Args {
 		int epoch;
 		int minCount;
 		int minCountLabel; 
+		int minCountFeature;
 		int neg;
 		loss_name loss;
 		model_name model;
@@ -47,6 +48,30 @@ class Args {
 		std::string pretrainedVectors;
 		std::string featurepad;
 		bool saveOutput;
+		int nodes;
+		int rank;
+		std::string master;
+		int syncRate;
+		int numa;
+		std::string incremental;
+		int vocabMemory;
+		int dedupBands;
+		int dedupMemory;
+		std::string vocab;
+		std::string vocabCounts;
+		bool saveFeature;
+		int cacheSize;
+		bool hash;
+		int seed;
+		std::string evalSim;
+		int evalRate;
+		bool evalBest;
+		bool reuseHidden;
+		int delaySentences;
+		int delayCap;
+		int64_t streamTokens;
+		std::string trace;
+		int traceEvents;
 
 		size_t cutoff;
 		void parseArgs(const std::vector<std::string>& args);
@@ -54,6 +79,7 @@ class Args {
 		void printBasicHelp();
 		void printDictionaryHelp();
 		void printTrainingHelp();
+		void printDistributedHelp();
 		void save(std::ostream&);
 		void load(std::istream&);
 };
@@ -67,6 +93,7 @@ Args::Args() {
 	ws = 5;
 	epoch = 5;
 	minCount = 10;
+	minCountFeature = 1;
 	neg = 5;
 	loss = loss_name::ns;
 	model = model_name::skipgram;
@@ -81,6 +108,29 @@ Args::Args() {
 	pretrainedVectors = "";
 	featurepad = 'N';
 	saveOutput = false;
+	nodes = 1;
+	rank = 0;
+	master = "127.0.0.1:23456";
+	syncRate = 1000000;
+	numa = 0;
+	vocabMemory = 0;
+	dedupBands = 8;
+	dedupMemory = 1024;
+	vocab = "";
+	vocabCounts = "";
+	saveFeature = false;
+	cacheSize = 100000;
+	hash = false;
+	seed = 0;
+	trace = "";
+	traceEvents = 100000;
+	evalSim = "";
+	evalRate = 0;
+	evalBest = false;
+	reuseHidden = false;
+	delaySentences = 0;
+	delayCap = 16;
+	streamTokens = 0;
 }
 
 /**
@@ -126,6 +176,8 @@ void Args::parseArgs(const std::vector<std::string>& args) {
 				epoch = std::stoi(args.at(ai + 1));
 			} else if (args[ai] == "-minCount") {
 				minCount = std::stoi(args.at(ai + 1));
+			} else if (args[ai] == "-minCountFeature") {
+				minCountFeature = std::stoi(args.at(ai + 1));
 			} else if (args[ai] == "-minCountLabel") {
 				minCountLabel = std::stoi(args.at(ai + 1));
 			} else if (args[ai] == "-neg") {
@@ -133,6 +185,8 @@ void Args::parseArgs(const std::vector<std::string>& args) {
 			} else if (args[ai] == "-loss") {
 				if (args.at(ai + 1) == "ns") {
 					loss = loss_name::ns;
+				} else if (args.at(ai + 1) == "hs") {
+					loss = loss_name::hs;
 				} else {
 					std::cerr << "Unknown loss: " << args.at(ai + 1) << std::endl;
 					printHelp();
@@ -140,6 +194,9 @@ void Args::parseArgs(const std::vector<std::string>& args) {
 				}
 			} else if (args[ai] == "-bucket") {
 				bucket = std::stoi(args.at(ai + 1));
+			} else if (args[ai] == "-hash") {
+				hash = true;
+				ai--;
 			} else if (args[ai] == "-minn") {
 				minn = std::stoi(args.at(ai + 1));
 			} else if (args[ai] == "-maxn") {
@@ -157,8 +214,57 @@ void Args::parseArgs(const std::vector<std::string>& args) {
 			} else if (args[ai] == "-saveOutput") {
 				saveOutput = true;
 				ai--;
+			} else if (args[ai] == "-saveFeature") {
+				saveFeature = true;
+				ai--;
+			} else if (args[ai] == "-evalBest") {
+				evalBest = true;
+				ai--;
+			} else if (args[ai] == "-reuseHidden") {
+				reuseHidden = true;
+				ai--;
+			} else if (args[ai] == "-delaySentences") {
+				delaySentences = std::stoi(args.at(ai + 1));
+			} else if (args[ai] == "-delayCap") {
+				delayCap = std::stoi(args.at(ai + 1));
+			} else if (args[ai] == "-streamTokens") {
+				streamTokens = std::stoll(args.at(ai + 1));
+			} else if (args[ai] == "-evalSim") {
+				evalSim = std::string(args.at(ai + 1));
+			} else if (args[ai] == "-evalRate") {
+				evalRate = std::stoi(args.at(ai + 1));
+			} else if (args[ai] == "-cacheSize") {
+				cacheSize = std::stoi(args.at(ai + 1));
 			} else if (args[ai] == "-cutoff") {
 				cutoff = std::stoi(args.at(ai + 1));
+			} else if (args[ai] == "-nodes") {
+				nodes = std::stoi(args.at(ai + 1));
+			} else if (args[ai] == "-rank") {
+				rank = std::stoi(args.at(ai + 1));
+			} else if (args[ai] == "-master") {
+				master = std::string(args.at(ai + 1));
+			} else if (args[ai] == "-syncRate") {
+				syncRate = std::stoi(args.at(ai + 1));
+			} else if (args[ai] == "-numa") {
+				numa = std::stoi(args.at(ai + 1));
+			} else if (args[ai] == "-vocabMemory") {
+				vocabMemory = std::stoi(args.at(ai + 1));
+			} else if (args[ai] == "-seed") {
+				seed = std::stoi(args.at(ai + 1));
+			} else if (args[ai] == "-trace") {
+				trace = std::string(args.at(ai + 1));
+			} else if (args[ai] == "-traceEvents") {
+				traceEvents = std::stoi(args.at(ai + 1));
+			} else if (args[ai] == "-dedupBands") {
+				dedupBands = std::stoi(args.at(ai + 1));
+			} else if (args[ai] == "-dedupMemory") {
+				dedupMemory = std::stoi(args.at(ai + 1));
+			} else if (args[ai] == "-vocab") {
+				vocab = std::string(args.at(ai + 1));
+			} else if (args[ai] == "-vocabCounts") {
+				vocabCounts = std::string(args.at(ai + 1));
+			} else if (args[ai] == "-incremental") {
+				incremental = std::string(args.at(ai + 1));
 			} else {
 				std::cerr << "Unknown argument: " << args[ai] << std::endl;
 				printHelp();
@@ -172,12 +278,54 @@ void Args::parseArgs(const std::vector<std::string>& args) {
 		}
 	}
 	
-	if (model == model_name::substoke && infeature == "") {
+	if (model == model_name::substoke && infeature == "" && incremental == "") {
 		std::cerr << "substoke need infeature file, [-infeature] is empty." << std::endl;
 		std::getchar();
 		printHelp();
 		exit(EXIT_FAILURE);
 	}
+
+	// the substoke word vectors are output rows, which are inner nodes under hs
+	if (model == model_name::substoke && loss == loss_name::hs) {
+		std::cerr << "substoke saves the output rows as word vectors, it needs -loss ns." << std::endl;
+		printHelp();
+		exit(EXIT_FAILURE);
+	}
+
+	if (dedupBands < 0 || dedupMemory < 1) {
+		std::cerr << "dedup need -dedupBands >= 0 and -dedupMemory >= 1." << std::endl;
+		printHelp();
+		exit(EXIT_FAILURE);
+	}
+
+	if (delaySentences < 0 || delayCap < 1) {
+		std::cerr << "delayed gradients need -delaySentences >= 0 and -delayCap >= 1." << std::endl;
+		printHelp();
+		exit(EXIT_FAILURE);
+	}
+
+	// only subword and substoke have ngram features
+	if (model == model_name::skipgram || model == model_name::cbow) {
+		hash = false;
+	}
+
+	if (hash && bucket <= 0) {
+		std::cerr << "hashed ngram features need -bucket >= 1." << std::endl;
+		printHelp();
+		exit(EXIT_FAILURE);
+	}
+
+	if (nodes < 1 || rank < 0 || rank >= nodes || syncRate < 1) {
+		std::cerr << "distributed training need -nodes >= 1, 0 <= -rank < -nodes and -syncRate >= 1." << std::endl;
+		printHelp();
+		exit(EXIT_FAILURE);
+	}
+
+	if (numa < 0 || numa > thread || (numa > 0 && nodes > 1)) {
+		std::cerr << "numa training need 0 <= -numa <= -thread and can not be combined with -nodes." << std::endl;
+		printHelp();
+		exit(EXIT_FAILURE);
+	}
 }
 
 /**
@@ -187,6 +335,7 @@ void Args::printHelp() {
 	printBasicHelp();
 	printDictionaryHelp();
 	printTrainingHelp();
+	printDistributedHelp();
 }
 
 /**
@@ -195,11 +344,14 @@ void Args::printHelp() {
 void Args::printBasicHelp() {
 	std::cerr
 		<< "\n The Following arguments are mandatory:\n"
-		<< "  -input						     training file path\n"
+		<< "  -input						     training file path, a directory, a glob, @manifest or - for stdin\n"
 		<< "  -infeature				 substoke feature file path\n"
 		<< "  -output							   output file path\n"
 		<< "\n The Following arguments are optional:\n"
 		<< "  -verbose   verbosity level[" << verbose << "]\n"
+		<< "  -cacheSize          word vectors cached by print-word-vectors default:[" << cacheSize << "]\n"
+		<< "  -trace              Chrome trace JSON of the scoped timers, needs -DW2V_TRACE=ON default:[" << trace << "]\n"
+		<< "  -traceEvents        timer events kept per scope and thread, later ones are only summed default:[" << traceEvents << "]\n"
 		<< std::endl;
 }
 
@@ -210,10 +362,17 @@ void Args::printDictionaryHelp() {
 	std::cerr
 		<< "\nThe following arguments for the dictionary are optional:\n"
 		<< "  -minCount           minimal number of word occurences default:[" << minCount << "]\n"
+		<< "  -minCountFeature    minimal number of occurences of an ngram feature default:[" << minCountFeature << "]\n"
 		<< "  -bucket             number of buckets default:[" << bucket << "]\n"
+		<< "  -hash               hash ngram features into -bucket rows default:[" << boolToString(hash) << "]\n"
 		<< "  -minn               min length of char ngram default:[" << minn << "]\n"
 		<< "  -maxn               max length of char ngram default:[" << maxn << "]\n"
-		<< "  -t                  sampling threshold default:[" << t << "]\n";
+		<< "  -t                  sampling threshold default:[" << t << "]\n"
+		<< "  -vocabMemory        MB to count the vocabulary in, 0 counts every word exactly default:[" << vocabMemory << "]\n"
+		<< "  -vocab              vocabulary cache, loaded if it matches the corpus, else written default:[" << vocab << "]\n"
+		<< "  -vocabCounts        \"word count\" file used instead of counting the corpus default:[" << vocabCounts << "]\n"
+		<< "  -dedupBands         MinHash bands of 8 rows dedup compares lines on, 0 drops only exact duplicates default:[" << dedupBands << "]\n"
+		<< "  -dedupMemory        MB of line hashes dedup keeps default:[" << dedupMemory << "]\n";
 }
 
 /**
@@ -228,10 +387,69 @@ void Args::printTrainingHelp() {
 		<< "  -ws                 size of the context window default:[" << ws << "]\n"
 		<< "  -epoch              number of epochs default:[" << epoch << "]\n"
 		<< "  -neg                number of negatives sampled default:[" << neg << "]\n"
-		<< "  -loss               loss function {ns} default:[" << lossToString(loss) << "]\n"
+		<< "  -loss               loss function {ns, hs} default:[" << lossToString(loss) << "]\n"
+		<< "  -reuseHidden        whether the hidden vector of a center word is computed once for its window and the input rows updated once default:[" << boolToString(reuseHidden) << "]\n"
+		<< "  -delaySentences     lines the input gradients of a thread are buffered for, 0 writes them at once default:[" << delaySentences << "]\n"
+		<< "  -delayCap           gradients a buffered row holds before it is written early default:[" << delayCap << "]\n"
 		<< "  -thread             number of threads default:[" << thread << "]\n"
+		<< "  -seed               seed of the random streams of the threads default:[" << seed << "]\n"
 		<< "  -pretrainedVectors  pretrained word vectors for supervised learning default:[" << pretrainedVectors << "]\n"
-		<< "  -saveOutput         whether output params should be saved default:[" << boolToString(saveOutput) << "]\n";
+		<< "  -saveOutput         whether output params should be saved default:[" << boolToString(saveOutput) << "]\n"
+		<< "  -saveFeature        whether the ngram feature vectors should be saved default:[" << boolToString(saveFeature) << "]\n"
+		<< "  -incremental        model (.bin) to continue training on the new -input, lr tapers from -lr default:[" << incremental << "]\n"
+		<< "  -streamTokens       tokens expected from -input -, 0 is -epoch times the corpus of the dictionary default:[" << streamTokens << "]\n"
+		<< "  -evalSim            comma separated \"word1 word2 score\" files evaluated during training default:[" << evalSim << "]\n"
+		<< "  -evalRate           tokens between two evaluations, 0 evaluates each epoch default:[" << evalRate << "]\n"
+		<< "  -evalBest           whether the best evaluated snapshot is saved instead of the last default:[" << boolToString(evalBest) << "]\n";
+}
+
+/**
+* @Function: print Help information.
+*/
+void Args::printDistributedHelp() {
+	std::cerr
+		<< "\nThe following arguments for distributed training are optional:\n"
+		<< "  -nodes              number of worker processes default:[" << nodes << "]\n"
+		<< "  -rank               rank of this worker, rank 0 averages the models default:[" << rank << "]\n"
+		<< "  -master             host:port of rank 0 default:[" << master << "]\n"
+		<< "  -syncRate           tokens per worker between two model averagings default:[" << syncRate << "]\n"
+		<< "  -numa               number of numa nodes with a pinned replica of the model, 0 shares one model default:[" << numa << "]\n";
+}
+
+/**
+* @Function: save the arguments which define the shape of a model.
+*/
+void Args::save(std::ostream& out) {
+	out.write((char*)&(dim), sizeof(int));
+	out.write((char*)&(ws), sizeof(int));
+	out.write((char*)&(epoch), sizeof(int));
+	out.write((char*)&(minCount), sizeof(int));
+	out.write((char*)&(neg), sizeof(int));
+	out.write((char*)&(loss), sizeof(loss_name));
+	out.write((char*)&(model), sizeof(model_name));
+	out.write((char*)&(bucket), sizeof(int));
+	out.write((char*)&(minn), sizeof(int));
+	out.write((char*)&(maxn), sizeof(int));
+	out.write((char*)&(t), sizeof(double));
+	out.write((char*)&(hash), sizeof(bool));
+}
+
+/**
+* @Function: load the arguments written by save().
+*/
+void Args::load(std::istream& in) {
+	in.read((char*)&(dim), sizeof(int));
+	in.read((char*)&(ws), sizeof(int));
+	in.read((char*)&(epoch), sizeof(int));
+	in.read((char*)&(minCount), sizeof(int));
+	in.read((char*)&(neg), sizeof(int));
+	in.read((char*)&(loss), sizeof(loss_name));
+	in.read((char*)&(model), sizeof(model_name));
+	in.read((char*)&(bucket), sizeof(int));
+	in.read((char*)&(minn), sizeof(int));
+	in.read((char*)&(maxn), sizeof(int));
+	in.read((char*)&(t), sizeof(double));
+	in.read((char*)&(hash), sizeof(bool));
 }
 
 /**
@@ -241,6 +459,8 @@ std::string Args::lossToString(loss_name ln) const {
 	switch (ln) {
 	case loss_name::ns:
 		return "ns";
+	case loss_name::hs:
+		return "hs";
 	}
 	return "Unknow loss!";
 }
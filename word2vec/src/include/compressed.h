@@ -0,0 +1,697 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: compressed.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: corpus input which is plain text, gzip or zstd. compressed input is
+*            decoded by a dedicated thread per stream, and an index of access
+*            points shared by all streams of a file lets a stream start at any
+*            uncompressed offset without decoding from the beginning.
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <streambuf>
+#include <stdexcept>
+#include <limits>
+#include <cstring>
+#include <cassert>
+
+#ifdef W2V_ZLIB
+#include <zlib.h>
+#endif
+#ifdef W2V_ZSTD
+#include <zstd.h>
+#endif
+
+enum class codec_name : int { plain = 0, gzip, zstd };
+
+/*
+  a position a decoder can start from. header points are the start of a gzip
+  member or zstd frame, the others are deflate block boundaries which need the
+  last 32KB of output and the unused bits of the byte before in.
+*/
+struct AccessPoint {
+	int64_t in;
+	int64_t out;
+	int32_t bits;
+	bool header;
+	std::vector<unsigned char> window;
+};
+
+class CompressedIndex {
+  protected:
+	std::mutex mutex_;
+	// sorted by out, points[0] is the start of the file
+	std::vector<AccessPoint> points_;
+	int64_t size_;
+
+	void readSeekTable(const std::string&);
+
+  public:
+	// uncompressed bytes between two access points, a gzip point costs 32KB
+	static const int64_t SPAN = 16 << 20;
+
+	CompressedIndex(const std::string&, codec_name);
+
+	static std::shared_ptr<CompressedIndex> get(const std::string&, codec_name);
+
+	AccessPoint find(int64_t);
+	bool wants(int64_t);
+	void add(const AccessPoint&);
+	int64_t size();
+	void setSize(int64_t);
+};
+
+CompressedIndex::CompressedIndex(const std::string& path, codec_name codec) : size_(-1) {
+	AccessPoint start = { 0, 0, 0, true, std::vector<unsigned char>() };
+	points_.push_back(start);
+	if (codec == codec_name::zstd) {
+		readSeekTable(path);
+	}
+}
+
+/**
+* @Function: one index per compressed file for the whole process.
+*/
+std::shared_ptr<CompressedIndex> CompressedIndex::get(const std::string& path, codec_name codec) {
+	static std::mutex mutex;
+	static std::map<std::string, std::shared_ptr<CompressedIndex> > indexes;
+	std::lock_guard<std::mutex> lock(mutex);
+	std::shared_ptr<CompressedIndex>& index = indexes[path];
+	if (!index) {
+		index = std::make_shared<CompressedIndex>(path, codec);
+	}
+	return index;
+}
+
+/**
+* @Function: every frame of a seekable zstd file is an access point, the seek
+*            table is a skippable frame ending in the 9 bytes footer
+*            uint32 frames, uint8 descriptor, uint32 magic 0x8F92EAB1.
+*/
+void CompressedIndex::readSeekTable(const std::string& path) {
+	std::ifstream ifs(path, std::ifstream::binary);
+	ifs.seekg(0, std::ios::end);
+	const int64_t fsize = ifs.tellg();
+	if (fsize < 9) {
+		return;
+	}
+	unsigned char footer[9];
+	ifs.seekg(fsize - 9);
+	ifs.read((char*)footer, 9);
+	uint32_t frames, magic;
+	std::memcpy(&frames, footer, 4);
+	std::memcpy(&magic, footer + 5, 4);
+	if (!ifs || magic != 0x8F92EAB1) {
+		return;
+	}
+	const int64_t entry = (footer[4] & 0x80) ? 12 : 8;
+	if (fsize < 9 + frames * entry) {
+		return;
+	}
+	std::vector<unsigned char> table(frames * entry);
+	ifs.seekg(fsize - 9 - frames * entry);
+	ifs.read((char*)table.data(), table.size());
+	if (!ifs) {
+		return;
+	}
+	int64_t in = 0, out = 0;
+	for (uint32_t i = 0; i < frames; i++) {
+		uint32_t csize, dsize;
+		std::memcpy(&csize, &table[i * entry], 4);
+		std::memcpy(&dsize, &table[i * entry + 4], 4);
+		if (i > 0) {
+			AccessPoint p = { in, out, 0, true, std::vector<unsigned char>() };
+			points_.push_back(p);
+		}
+		in += csize;
+		out += dsize;
+	}
+	size_ = out;
+}
+
+/**
+* @Function: the last access point at or before out.
+*/
+AccessPoint CompressedIndex::find(int64_t out) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto it = std::upper_bound(points_.begin(), points_.end(), out,
+		[](int64_t o, const AccessPoint& p) { return o < p.out; });
+	return *(it - 1);
+}
+
+/**
+* @Function: whether a point at out is at least SPAN away from the known ones.
+*/
+bool CompressedIndex::wants(int64_t out) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto it = std::upper_bound(points_.begin(), points_.end(), out,
+		[](int64_t o, const AccessPoint& p) { return o < p.out; });
+	if (out - (it - 1)->out < SPAN) {
+		return false;
+	}
+	return it == points_.end() || it->out - out >= SPAN;
+}
+
+void CompressedIndex::add(const AccessPoint& point) {
+	if (!wants(point.out)) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto it = std::upper_bound(points_.begin(), points_.end(), point.out,
+		[](int64_t o, const AccessPoint& p) { return o < p.out; });
+	points_.insert(it, point);
+}
+
+/**
+* @Function: uncompressed size, -1 until a decoder reached the end.
+*/
+int64_t CompressedIndex::size() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return size_;
+}
+
+void CompressedIndex::setSize(int64_t size) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	size_ = size;
+}
+
+/**
+* @Function: sequential decoder of one compressed file, it records access points
+*            into the index while decoding.
+*/
+class Decoder {
+  protected:
+	std::string path_;
+	std::ifstream file_;
+	std::shared_ptr<CompressedIndex> index_;
+	std::vector<unsigned char> in_;
+	// compressed offset of in_[0]
+	int64_t inBase_;
+	// uncompressed offset of the next byte read() returns
+	int64_t out_;
+	bool ended_;
+
+	static const size_t IN_SIZE = 1 << 18;
+
+	size_t fill(int64_t);
+
+  public:
+	Decoder(const std::string&, std::shared_ptr<CompressedIndex>);
+	virtual ~Decoder() {}
+
+	virtual void start(const AccessPoint&) = 0;
+	virtual size_t read(char*, size_t) = 0;
+
+	static std::unique_ptr<Decoder> create(const std::string&, codec_name, std::shared_ptr<CompressedIndex>);
+};
+
+Decoder::Decoder(const std::string& path, std::shared_ptr<CompressedIndex> index)
+	: path_(path), file_(path, std::ifstream::binary), index_(index), in_(IN_SIZE), inBase_(0), out_(0), ended_(false) {
+	if (!file_.is_open()) {
+		throw std::invalid_argument(path + " cannot be opened for decoding!");
+	}
+}
+
+/**
+* @Function: read compressed bytes starting at offset into in_.
+*/
+size_t Decoder::fill(int64_t offset) {
+	file_.clear();
+	file_.seekg(std::streampos(offset));
+	file_.read((char*)in_.data(), in_.size());
+	inBase_ = offset;
+	return file_.gcount();
+}
+
+#ifdef W2V_ZLIB
+class GzipDecoder : public Decoder {
+  protected:
+	z_stream strm_;
+	bool init_;
+	bool raw_;
+	// the last 32KB of output, circular
+	std::vector<unsigned char> window_;
+	size_t wpos_;
+	size_t wfill_;
+
+	static const size_t WINDOW = 32768;
+
+	void remember(const unsigned char*, size_t);
+	int64_t consumed() const;
+	bool refill();
+	void reset(bool);
+
+  public:
+	GzipDecoder(const std::string&, std::shared_ptr<CompressedIndex>);
+	~GzipDecoder();
+
+	void start(const AccessPoint&);
+	size_t read(char*, size_t);
+};
+
+GzipDecoder::GzipDecoder(const std::string& path, std::shared_ptr<CompressedIndex> index)
+	: Decoder(path, index), init_(false), raw_(false), window_(WINDOW), wpos_(0), wfill_(0) {
+	std::memset(&strm_, 0, sizeof(z_stream));
+}
+
+GzipDecoder::~GzipDecoder() {
+	if (init_) {
+		inflateEnd(&strm_);
+	}
+}
+
+void GzipDecoder::remember(const unsigned char* data, size_t n) {
+	if (n >= WINDOW) {
+		std::memcpy(window_.data(), data + n - WINDOW, WINDOW);
+		wpos_ = 0;
+		wfill_ = WINDOW;
+		return;
+	}
+	size_t first = std::min(n, WINDOW - wpos_);
+	std::memcpy(window_.data() + wpos_, data, first);
+	std::memcpy(window_.data(), data + first, n - first);
+	wpos_ = (wpos_ + n) % WINDOW;
+	wfill_ = std::min(wfill_ + n, size_t(WINDOW));
+}
+
+int64_t GzipDecoder::consumed() const {
+	return inBase_ + (strm_.next_in - in_.data());
+}
+
+/**
+* @Function: read the next compressed bytes, false at the end of the file.
+*/
+bool GzipDecoder::refill() {
+	size_t n = fill(consumed());
+	strm_.next_in = in_.data();
+	strm_.avail_in = n;
+	return n > 0;
+}
+
+/**
+* @Function: raw inflate resumes inside a member, gzip inflate reads a member header.
+*/
+void GzipDecoder::reset(bool raw) {
+	raw_ = raw;
+	int ret = init_ ? inflateReset2(&strm_, raw ? -15 : 31) : inflateInit2(&strm_, raw ? -15 : 31);
+	init_ = true;
+	if (ret != Z_OK) {
+		throw std::runtime_error("zlib cannot be initialized for " + path_);
+	}
+}
+
+void GzipDecoder::start(const AccessPoint& point) {
+	ended_ = false;
+	out_ = point.out;
+	wpos_ = 0;
+	wfill_ = 0;
+	remember(point.window.data(), point.window.size());
+	int64_t offset = point.in - (point.bits ? 1 : 0);
+	size_t n = fill(offset);
+	strm_.next_in = in_.data();
+	strm_.avail_in = n;
+	reset(!point.header);
+	if (point.bits) {
+		if (n == 0) {
+			throw std::runtime_error(path_ + " is truncated.");
+		}
+		int value = strm_.next_in[0];
+		strm_.next_in++;
+		strm_.avail_in--;
+		inflatePrime(&strm_, point.bits, value >> (8 - point.bits));
+	}
+	if (!point.header) {
+		inflateSetDictionary(&strm_, point.window.data(), point.window.size());
+	}
+}
+
+/**
+* @Function: decode up to n bytes, 0 at the end of the file. block boundaries are
+*            offered to the index as access points, members are decoded one after
+*            another like gzip -dc does.
+*/
+size_t GzipDecoder::read(char* buf, size_t n) {
+	strm_.next_out = (unsigned char*)buf;
+	strm_.avail_out = n;
+	while (strm_.avail_out > 0 && !ended_) {
+		if (strm_.avail_in == 0 && !refill()) {
+			// only an empty file ends outside a member boundary
+			if (out_ > 0 || strm_.total_in > 0) {
+				throw std::runtime_error(path_ + " is truncated.");
+			}
+			ended_ = true;
+			break;
+		}
+		unsigned char* before = strm_.next_out;
+		int ret = inflate(&strm_, Z_BLOCK);
+		if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR) {
+			throw std::runtime_error(path_ + " is corrupted: " + (strm_.msg ? strm_.msg : "inflate failed"));
+		}
+		size_t produced = strm_.next_out - before;
+		remember(before, produced);
+		out_ += produced;
+		if (ret == Z_STREAM_END) {
+			if (raw_) {
+				// a raw stream stops before the 8 bytes gzip trailer
+				for (int32_t i = 0; i < 8; i++) {
+					if (strm_.avail_in == 0 && !refill()) {
+						throw std::runtime_error(path_ + " is truncated.");
+					}
+					strm_.next_in++;
+					strm_.avail_in--;
+				}
+			}
+			if (strm_.avail_in == 0 && !refill()) {
+				ended_ = true;
+				break;
+			}
+			reset(false);
+			AccessPoint p = { consumed(), out_, 0, true, std::vector<unsigned char>() };
+			index_->add(p);
+		} else if ((strm_.data_type & 128) && !(strm_.data_type & 64) && index_->wants(out_)) {
+			AccessPoint p = { consumed(), out_, strm_.data_type & 7, false, std::vector<unsigned char>(wfill_) };
+			size_t tail = wfill_ < WINDOW ? 0 : wpos_;
+			for (size_t i = 0; i < wfill_; i++) {
+				p.window[i] = window_[(tail + i) % WINDOW];
+			}
+			index_->add(p);
+		}
+	}
+	if (ended_) {
+		index_->setSize(out_);
+	}
+	return n - strm_.avail_out;
+}
+#endif
+
+#ifdef W2V_ZSTD
+class ZstdDecoder : public Decoder {
+  protected:
+	ZSTD_DCtx* dctx_;
+	ZSTD_inBuffer input_;
+
+  public:
+	ZstdDecoder(const std::string&, std::shared_ptr<CompressedIndex>);
+	~ZstdDecoder();
+
+	void start(const AccessPoint&);
+	size_t read(char*, size_t);
+};
+
+ZstdDecoder::ZstdDecoder(const std::string& path, std::shared_ptr<CompressedIndex> index)
+	: Decoder(path, index), dctx_(ZSTD_createDCtx()) {
+	if (dctx_ == NULL) {
+		throw std::runtime_error("zstd cannot be initialized for " + path);
+	}
+	input_.src = in_.data();
+	input_.size = 0;
+	input_.pos = 0;
+}
+
+ZstdDecoder::~ZstdDecoder() {
+	ZSTD_freeDCtx(dctx_);
+}
+
+void ZstdDecoder::start(const AccessPoint& point) {
+	ended_ = false;
+	out_ = point.out;
+	ZSTD_DCtx_reset(dctx_, ZSTD_reset_session_only);
+	input_.size = fill(point.in);
+	input_.pos = 0;
+}
+
+/**
+* @Function: decode up to n bytes, 0 at the end of the file. every frame start
+*            is offered to the index as an access point.
+*/
+size_t ZstdDecoder::read(char* buf, size_t n) {
+	ZSTD_outBuffer output = { buf, n, 0 };
+	while (output.pos < n && !ended_) {
+		if (input_.pos == input_.size) {
+			input_.size = fill(inBase_ + input_.pos);
+			input_.pos = 0;
+			if (input_.size == 0) {
+				ended_ = true;
+				break;
+			}
+		}
+		size_t ret = ZSTD_decompressStream(dctx_, &output, &input_);
+		if (ZSTD_isError(ret)) {
+			throw std::runtime_error(path_ + " is corrupted: " + ZSTD_getErrorName(ret));
+		}
+		if (ret == 0) {
+			AccessPoint p = { int64_t(inBase_ + input_.pos), int64_t(out_ + output.pos), 0, true, std::vector<unsigned char>() };
+			index_->add(p);
+		}
+	}
+	out_ += output.pos;
+	if (ended_) {
+		index_->setSize(out_);
+	}
+	return output.pos;
+}
+#endif
+
+std::unique_ptr<Decoder> Decoder::create(const std::string& path, codec_name codec, std::shared_ptr<CompressedIndex> index) {
+#ifdef W2V_ZLIB
+	if (codec == codec_name::gzip) {
+		return std::unique_ptr<Decoder>(new GzipDecoder(path, index));
+	}
+#endif
+#ifdef W2V_ZSTD
+	if (codec == codec_name::zstd) {
+		return std::unique_ptr<Decoder>(new ZstdDecoder(path, index));
+	}
+#endif
+	throw std::invalid_argument(path + " is compressed but word2vec was built without "
+		+ (codec == codec_name::gzip ? "zlib." : "zstd."));
+}
+
+/**
+* @Function: decode a file from its last access point to the end, so its index
+*            has a point every SPAN bytes and knows the uncompressed size. a
+*            file decoded to the end before costs nothing.
+*/
+int64_t indexCompressed(const std::string& path, codec_name codec) {
+	std::shared_ptr<CompressedIndex> index = CompressedIndex::get(path, codec);
+	int64_t size = index->size();
+	if (size >= 0) {
+		return size;
+	}
+	std::unique_ptr<Decoder> decoder = Decoder::create(path, codec, index);
+	decoder->start(index->find(std::numeric_limits<int64_t>::max()));
+	std::vector<char> scratch(1 << 20);
+	while (decoder->read(scratch.data(), scratch.size()) > 0) {
+	}
+	return index->size();
+}
+
+/**
+* @Function: stream buffer fed by a decoding thread through a queue of chunks.
+*            a seek stops the thread, the next read starts it again at the new
+*            offset from the closest access point.
+*/
+class DecompressBuf : public std::streambuf {
+  protected:
+	static const size_t CHUNK = 1 << 20;
+	static const size_t QUEUE = 4;
+
+	std::string path_;
+	codec_name codec_;
+	std::shared_ptr<CompressedIndex> index_;
+	std::thread worker_;
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	std::deque<std::vector<char> > full_;
+	std::vector<std::vector<char> > free_;
+	std::vector<char> current_;
+	bool done_;
+	bool stop_;
+	std::exception_ptr error_;
+	// uncompressed offset of current_[0]
+	int64_t base_;
+
+	// QUEUE chunks circulate between free_, full_, the thread and current_
+	void recycle();
+
+	void produce(int64_t);
+	void start();
+	void stop();
+	int64_t measure();
+
+	int_type underflow();
+	pos_type seekoff(off_type, std::ios_base::seekdir, std::ios_base::openmode);
+	pos_type seekpos(pos_type, std::ios_base::openmode);
+
+  public:
+	DecompressBuf(const std::string&, codec_name);
+	~DecompressBuf();
+};
+
+DecompressBuf::DecompressBuf(const std::string& path, codec_name codec)
+	: path_(path), codec_(codec), index_(CompressedIndex::get(path, codec)), done_(false), stop_(false), base_(0) {
+	setg(NULL, NULL, NULL);
+}
+
+DecompressBuf::~DecompressBuf() {
+	stop();
+}
+
+/**
+* @Function: the decoding thread, it skips from the access point to offset and
+*            then fills free chunks until the end of the file.
+*/
+void DecompressBuf::produce(int64_t offset) {
+	try {
+		std::unique_ptr<Decoder> decoder = Decoder::create(path_, codec_, index_);
+		AccessPoint point = index_->find(offset);
+		decoder->start(point);
+		std::vector<char> scratch(CHUNK);
+		for (int64_t skip = offset - point.out; skip > 0;) {
+			size_t n = decoder->read(scratch.data(), std::min<int64_t>(skip, CHUNK));
+			if (n == 0)
+				break;
+			skip -= n;
+		}
+		while (true) {
+			std::vector<char> buf;
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				cv_.wait(lock, [this]() { return stop_ || !free_.empty(); });
+				if (stop_)
+					return;
+				buf.swap(free_.back());
+				free_.pop_back();
+			}
+			buf.resize(CHUNK);
+			size_t n = decoder->read(buf.data(), CHUNK);
+			buf.resize(n);
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (n == 0) {
+				done_ = true;
+			} else {
+				full_.push_back(std::vector<char>());
+				full_.back().swap(buf);
+			}
+			cv_.notify_all();
+			if (n == 0)
+				return;
+		}
+	} catch (...) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		error_ = std::current_exception();
+		done_ = true;
+		cv_.notify_all();
+	}
+}
+
+void DecompressBuf::start() {
+	done_ = false;
+	stop_ = false;
+	error_ = std::exception_ptr();
+	assert(free_.size() + full_.size() <= QUEUE);
+	while (free_.size() < QUEUE) {
+		free_.push_back(std::vector<char>());
+	}
+	worker_ = std::thread(&DecompressBuf::produce, this, base_);
+}
+
+void DecompressBuf::stop() {
+	if (!worker_.joinable()) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+		cv_.notify_all();
+	}
+	worker_.join();
+	while (!full_.empty()) {
+		free_.push_back(std::vector<char>());
+		free_.back().swap(full_.front());
+		full_.pop_front();
+	}
+}
+
+DecompressBuf::int_type DecompressBuf::underflow() {
+	if (gptr() < egptr()) {
+		return traits_type::to_int_type(*gptr());
+	}
+	if (!worker_.joinable()) {
+		start();
+	}
+	std::unique_lock<std::mutex> lock(mutex_);
+	cv_.wait(lock, [this]() { return done_ || !full_.empty(); });
+	if (full_.empty()) {
+		if (error_) {
+			std::rethrow_exception(error_);
+		}
+		return traits_type::eof();
+	}
+	base_ += egptr() - eback();
+	recycle();
+	current_.swap(full_.front());
+	full_.pop_front();
+	cv_.notify_all();
+	setg(current_.data(), current_.data(), current_.data() + current_.size());
+	return traits_type::to_int_type(*gptr());
+}
+
+/**
+* @Function: give current_ back to free_, an empty one is not a chunk of the
+*            queue and is left out so the number of chunks stays QUEUE.
+*/
+void DecompressBuf::recycle() {
+	if (current_.empty()) {
+		return;
+	}
+	free_.push_back(std::vector<char>());
+	free_.back().swap(current_);
+}
+
+/**
+* @Function: uncompressed size, decoded from the last access point if unknown.
+*/
+int64_t DecompressBuf::measure() {
+	return indexCompressed(path_, codec_);
+}
+
+DecompressBuf::pos_type DecompressBuf::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode mode) {
+	if (dir == std::ios_base::cur) {
+		return seekpos(pos_type(base_ + (gptr() - eback()) + off), mode);
+	}
+	if (dir == std::ios_base::end) {
+		return seekpos(pos_type(measure() + off), mode);
+	}
+	return seekpos(pos_type(off), mode);
+}
+
+DecompressBuf::pos_type DecompressBuf::seekpos(pos_type pos, std::ios_base::openmode) {
+	const int64_t offset = pos;
+	if (offset < 0) {
+		return pos_type(off_type(-1));
+	}
+	if (offset >= base_ && offset <= base_ + (egptr() - eback())) {
+		setg(eback(), eback() + (offset - base_), egptr());
+		return pos;
+	}
+	stop();
+	recycle();
+	setg(NULL, NULL, NULL);
+	base_ = offset;
+	return pos;
+}
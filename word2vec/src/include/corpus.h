@@ -0,0 +1,383 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: corpus.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: the corpus of -input, one file, a directory, a glob or a manifest
+*            of files read as one stream. every file is followed by a newline in
+*            the stream, so sizes and offsets cover all the files and a thread
+*            seeking to an offset lands in the right file.
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <fstream>
+#include <iostream>
+#include <streambuf>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <glob.h>
+
+#include "compressed.h"
+
+// bytes [begin, end) of a file, end is -1 up to the end of the file
+struct CorpusRange {
+	std::string path;
+	int64_t begin;
+	int64_t end;
+	// the range ends the file and the stream has a newline after it
+	bool separator;
+};
+
+/**
+* @Function: stream buffer over a list of files, the files are opened one at a
+*            time and a newline is inserted after each of them.
+*/
+class MultiFileBuf : public std::streambuf {
+  protected:
+	static const size_t BUFFER = 1 << 16;
+
+	std::vector<std::string> files_;
+	// uncompressed sizes, -1 until known
+	std::vector<int64_t> sizes_;
+	std::unique_ptr<std::streambuf> file_;
+	std::vector<char> buffer_;
+	// file read next, offset in it and whether its newline is next
+	size_t current_;
+	int64_t offset_;
+	bool separator_;
+	// stream offset of eback()
+	int64_t base_;
+
+	int64_t fileSize(size_t);
+
+	int_type underflow();
+	pos_type seekoff(off_type, std::ios_base::seekdir, std::ios_base::openmode);
+	pos_type seekpos(pos_type, std::ios_base::openmode);
+
+  public:
+	explicit MultiFileBuf(const std::vector<std::string>&);
+};
+
+/**
+* @Function: input stream of a corpus, gzip and zstd files are recognized by
+*            their magic bytes and decoded on the fly.
+*/
+class Corpus : public std::istream {
+  protected:
+	std::unique_ptr<std::streambuf> buf_;
+	std::string input_;
+
+	static void listDirectory(const std::string&, std::vector<std::string>&);
+
+  public:
+	explicit Corpus(const std::string&);
+
+	bool is_open() const;
+	void close();
+	const std::string& input() const;
+	static codec_name codecOf(const std::string&);
+	static std::unique_ptr<std::streambuf> open(const std::string&);
+	static std::vector<std::string> expand(const std::string&);
+	static std::vector<std::vector<CorpusRange> > partition(const std::string&, int32_t);
+	static void index(const std::string&);
+};
+
+MultiFileBuf::MultiFileBuf(const std::vector<std::string>& files)
+	: files_(files), sizes_(files.size(), -1), buffer_(BUFFER), current_(0), offset_(0), separator_(false), base_(0) {
+	setg(NULL, NULL, NULL);
+}
+
+/**
+* @Function: plain sizes come from stat, compressed ones from their index.
+*/
+int64_t MultiFileBuf::fileSize(size_t i) {
+	if (sizes_[i] < 0) {
+		std::unique_ptr<std::streambuf> buf = Corpus::open(files_[i]);
+		if (!buf) {
+			throw std::invalid_argument(files_[i] + " cannot be opened for training!");
+		}
+		sizes_[i] = buf->pubseekoff(0, std::ios_base::end, std::ios_base::in);
+	}
+	return sizes_[i];
+}
+
+MultiFileBuf::int_type MultiFileBuf::underflow() {
+	if (gptr() < egptr()) {
+		return traits_type::to_int_type(*gptr());
+	}
+	base_ += egptr() - eback();
+	if (current_ >= files_.size()) {
+		setg(NULL, NULL, NULL);
+		return traits_type::eof();
+	}
+	if (!separator_) {
+		if (!file_) {
+			file_ = Corpus::open(files_[current_]);
+			if (!file_) {
+				throw std::invalid_argument(files_[current_] + " cannot be opened for training!");
+			}
+			if (offset_ > 0) {
+				file_->pubseekpos(offset_, std::ios_base::in);
+			}
+		}
+		std::streamsize n = file_->sgetn(buffer_.data(), BUFFER);
+		if (n > 0) {
+			offset_ += n;
+			setg(buffer_.data(), buffer_.data(), buffer_.data() + n);
+			return traits_type::to_int_type(*gptr());
+		}
+		sizes_[current_] = offset_;
+		file_.reset();
+	}
+	separator_ = false;
+	current_++;
+	offset_ = 0;
+	buffer_[0] = '\n';
+	setg(buffer_.data(), buffer_.data(), buffer_.data() + 1);
+	return traits_type::to_int_type(*gptr());
+}
+
+MultiFileBuf::pos_type MultiFileBuf::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode mode) {
+	if (dir == std::ios_base::cur) {
+		return seekpos(pos_type(base_ + (gptr() - eback()) + off), mode);
+	}
+	if (dir == std::ios_base::end) {
+		int64_t total = 0;
+		for (size_t i = 0; i < files_.size(); i++) {
+			total += fileSize(i) + 1;
+		}
+		return seekpos(pos_type(total + off), mode);
+	}
+	return seekpos(pos_type(off), mode);
+}
+
+/**
+* @Function: find the file holding pos, it is opened by the next read.
+*/
+MultiFileBuf::pos_type MultiFileBuf::seekpos(pos_type pos, std::ios_base::openmode) {
+	const int64_t offset = pos;
+	if (offset < 0) {
+		return pos_type(off_type(-1));
+	}
+	if (offset >= base_ && offset < base_ + (egptr() - eback())) {
+		setg(eback(), eback() + (offset - base_), egptr());
+		return pos;
+	}
+	file_.reset();
+	setg(NULL, NULL, NULL);
+	base_ = offset;
+	int64_t start = 0;
+	for (current_ = 0; current_ < files_.size(); current_++) {
+		const int64_t size = fileSize(current_);
+		if (offset <= start + size) {
+			offset_ = offset - start;
+			separator_ = offset_ == size;
+			return pos;
+		}
+		start += size + 1;
+	}
+	offset_ = 0;
+	separator_ = false;
+	return pos;
+}
+
+/**
+* @Function: a single file is read as it is, several files through MultiFileBuf.
+*/
+Corpus::Corpus(const std::string& input) : std::istream(NULL), input_(input) {
+	std::vector<std::string> files = expand(input);
+	if (files.size() == 1 && files[0] == input) {
+		buf_ = open(input);
+	} else if (!files.empty()) {
+		buf_.reset(new MultiFileBuf(files));
+	}
+	if (!buf_) {
+		setstate(std::ios_base::failbit);
+		return;
+	}
+	rdbuf(buf_.get());
+}
+
+bool Corpus::is_open() const {
+	return buf_ != NULL;
+}
+
+void Corpus::close() {
+	rdbuf(NULL);
+	buf_.reset();
+}
+
+const std::string& Corpus::input() const {
+	return input_;
+}
+
+codec_name Corpus::codecOf(const std::string& path) {
+	std::ifstream ifs(path, std::ifstream::binary);
+	unsigned char magic[4] = { 0, 0, 0, 0 };
+	ifs.read((char*)magic, 4);
+	if (magic[0] == 0x1f && magic[1] == 0x8b) {
+		return codec_name::gzip;
+	}
+	if (magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+		return codec_name::zstd;
+	}
+	return codec_name::plain;
+}
+
+/**
+* @Function: stream buffer of one file, NULL if it cannot be opened.
+*/
+std::unique_ptr<std::streambuf> Corpus::open(const std::string& path) {
+	codec_name codec = codecOf(path);
+	if (codec != codec_name::plain) {
+		return std::unique_ptr<std::streambuf>(new DecompressBuf(path, codec));
+	}
+	std::unique_ptr<std::filebuf> fb(new std::filebuf());
+	if (fb->open(path, std::ios_base::in | std::ios_base::binary) == NULL) {
+		return std::unique_ptr<std::streambuf>();
+	}
+	return std::unique_ptr<std::streambuf>(fb.release());
+}
+
+/**
+* @Function: regular files under a directory, hidden entries are skipped.
+*/
+void Corpus::listDirectory(const std::string& dir, std::vector<std::string>& files) {
+	DIR* d = opendir(dir.c_str());
+	if (d == NULL) {
+		return;
+	}
+	struct dirent* entry;
+	while ((entry = readdir(d)) != NULL) {
+		if (entry->d_name[0] == '.') {
+			continue;
+		}
+		std::string path = dir + (dir[dir.size() - 1] == '/' ? "" : "/") + entry->d_name;
+		struct stat info;
+		if (::stat(path.c_str(), &info) != 0) {
+			continue;
+		}
+		if (S_ISDIR(info.st_mode)) {
+			listDirectory(path, files);
+		} else if (S_ISREG(info.st_mode)) {
+			files.push_back(path);
+		}
+	}
+	closedir(d);
+}
+
+/**
+* @Function: files of -input in reading order. "@list" is a manifest with a
+*            path per line relative to it, a directory is read recursively in
+*            path order and a pattern with * ? or [ is expanded by glob.
+*/
+std::vector<std::string> Corpus::expand(const std::string& input) {
+	std::vector<std::string> files;
+	if (input.size() > 1 && input[0] == '@') {
+		std::string manifest = input.substr(1);
+		std::ifstream ifs(manifest);
+		if (!ifs.is_open()) {
+			return files;
+		}
+		size_t slash = manifest.find_last_of('/');
+		std::string dir = slash == std::string::npos ? "" : manifest.substr(0, slash + 1);
+		std::string line;
+		while (std::getline(ifs, line)) {
+			line.erase(line.find_last_not_of(" \t\r") + 1);
+			if (line.empty() || line[0] == '#') {
+				continue;
+			}
+			std::vector<std::string> more = expand(line[0] == '/' ? line : dir + line);
+			files.insert(files.end(), more.begin(), more.end());
+		}
+		return files;
+	}
+	struct stat info;
+	if (::stat(input.c_str(), &info) == 0) {
+		if (S_ISDIR(info.st_mode)) {
+			listDirectory(input, files);
+			std::sort(files.begin(), files.end());
+		} else {
+			files.push_back(input);
+		}
+		return files;
+	}
+	if (input.find_first_of("*?[") != std::string::npos) {
+		glob_t matches;
+		if (glob(input.c_str(), 0, NULL, &matches) == 0) {
+			for (size_t i = 0; i < matches.gl_pathc; i++) {
+				if (::stat(matches.gl_pathv[i], &info) == 0 && S_ISREG(info.st_mode)) {
+					files.push_back(matches.gl_pathv[i]);
+				}
+			}
+		}
+		globfree(&matches);
+	}
+	return files;
+}
+
+/**
+* @Function: split the files of input into n parts of about the same size on
+*            disk, in reading order. plain files may be split into ranges, a
+*            compressed file always goes whole to one part.
+*/
+std::vector<std::vector<CorpusRange> > Corpus::partition(const std::string& input, int32_t n) {
+	std::vector<std::string> files = expand(input);
+	const bool separated = !(files.size() == 1 && files[0] == input);
+	std::vector<int64_t> sizes(files.size(), 0);
+	int64_t total = 0;
+	for (size_t i = 0; i < files.size(); i++) {
+		struct stat info;
+		if (::stat(files[i].c_str(), &info) == 0) {
+			sizes[i] = info.st_size;
+		}
+		total += sizes[i];
+	}
+	std::vector<std::vector<CorpusRange> > parts(n);
+	const int64_t per = std::max<int64_t>(1, (total + n - 1) / n);
+	int32_t part = 0;
+	int64_t filled = 0;
+	for (size_t i = 0; i < files.size(); i++) {
+		const bool splittable = codecOf(files[i]) == codec_name::plain;
+		int64_t begin = 0;
+		do {
+			int64_t take = sizes[i] - begin;
+			if (splittable && part < n - 1) {
+				take = std::min(take, per - filled);
+			}
+			const int64_t end = begin + take;
+			CorpusRange range = { files[i], begin, end < sizes[i] ? end : -1, end >= sizes[i] && separated };
+			parts[part].push_back(range);
+			filled += take;
+			begin = end;
+			if (filled >= per && part < n - 1) {
+				part++;
+				filled = 0;
+			}
+		} while (begin < sizes[i]);
+	}
+	return parts;
+}
+
+/**
+* @Function: decode every compressed file of input once, so threads seeking into
+*            it start from an access point instead of from the beginning. the
+*            counting pass builds the same index, after a -vocab cache hit or
+*            with -vocabCounts nothing else would.
+*/
+void Corpus::index(const std::string& input) {
+	std::vector<std::string> files = expand(input);
+	for (size_t i = 0; i < files.size(); i++) {
+		codec_name codec = codecOf(files[i]);
+		if (codec != codec_name::plain) {
+			indexCompressed(files[i], codec);
+		}
+	}
+}
@@ -0,0 +1,276 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: dedup.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: drop the repeated lines of a corpus before training, a line is
+*            dropped when its words equal an earlier line or when its MinHash
+*            signature shares a band with one. the threads hash a batch of
+*            lines and the lines are then kept or dropped in order, so the
+*            first occurrence stays. the hashes live in fixed size tables.
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdint>
+
+#include "args.h"
+#include "trace.h"
+#include "utils.h"
+
+class Dedup {
+  protected:
+	// minhash values of a band, a near duplicate matches all of them in a band
+	static const int32_t ROWS = 8;
+	// words of a shingle
+	static const int32_t SHINGLE = 3;
+	// lines hashed by the threads at once
+	static const size_t BATCH_LINES = 1 << 16;
+
+	std::shared_ptr<Args> args_;
+	// sets of 64 bits keys with open addressing, 0 is an empty slot. table 0
+	// holds the hashes of the lines, table 1 + b the keys of band b
+	std::vector<std::vector<uint64_t> > tables_;
+	std::vector<int64_t> filled_;
+	// slots a table may grow to
+	size_t capacity_;
+	bool full_;
+
+	int64_t lines_;
+	int64_t exact_;
+	int64_t near_;
+	int64_t tokens_;
+	int64_t removed_;
+
+	static inline uint64_t mix(uint64_t h) {
+		h ^= h >> 30;
+		h *= 0xbf58476d1ce4e5b9ULL;
+		h ^= h >> 27;
+		h *= 0x94d049bb133111ebULL;
+		return h ^ (h >> 31);
+	}
+
+	int32_t hashLine(const std::string&, uint64_t*) const;
+	bool find(int32_t, uint64_t) const;
+	void insert(int32_t, uint64_t);
+	void grow(int32_t);
+
+  public:
+	explicit Dedup(std::shared_ptr<Args>);
+
+	void filter(std::istream&, std::ostream&);
+	void printInfo() const;
+};
+
+/**
+* @Function: the tables start small and double up to their share of
+*            -dedupMemory MB, split over the table of lines and the
+*            -dedupBands tables of bands.
+*/
+Dedup::Dedup(std::shared_ptr<Args> args) : args_(args), full_(false), lines_(0), exact_(0), near_(0), tokens_(0), removed_(0) {
+	const int32_t ntables = 1 + args_->dedupBands;
+	const uint64_t slots = (uint64_t(args_->dedupMemory) << 20) / sizeof(uint64_t) / ntables;
+	capacity_ = 1024;
+	while (2 * capacity_ <= slots) {
+		capacity_ *= 2;
+	}
+	tables_.assign(ntables, std::vector<uint64_t>(std::min<size_t>(capacity_, 1 << 16), 0));
+	filled_.assign(ntables, 0);
+}
+
+/**
+* @Function: the hash of the words of a line and the key of every band of its
+*            signature, the words are split by utils::nextWord() as in
+*            readWord(). 0 words give 0 keys.
+*/
+int32_t Dedup::hashLine(const std::string& line, uint64_t* keys) const {
+	const int32_t bands = args_->dedupBands;
+	std::vector<uint64_t> words;
+	size_t pos = 0, begin;
+	while (utils::nextWord(line, pos, begin)) {
+		uint64_t h = 14695981039346656037ULL;
+		for (size_t i = begin; i < pos; i++) {
+			h = (h ^ uint8_t(line[i])) * 1099511628211ULL;
+		}
+		words.push_back(mix(h));
+	}
+	std::fill(keys, keys + 1 + bands, 0);
+	if (words.empty()) {
+		return 0;
+	}
+	uint64_t exact = words.size();
+	for (size_t i = 0; i < words.size(); i++) {
+		exact = mix(exact ^ words[i]);
+	}
+	keys[0] = std::max<uint64_t>(exact, 1);
+	if (bands == 0) {
+		return words.size();
+	}
+
+	// a line shorter than a shingle is one shingle
+	const int32_t width = std::min<int32_t>(SHINGLE, words.size());
+	const int32_t nhashes = bands * ROWS;
+	std::vector<uint64_t> signature(nhashes, UINT64_MAX);
+	for (size_t i = 0; i + width <= words.size(); i++) {
+		uint64_t shingle = 0;
+		for (int32_t j = 0; j < width; j++) {
+			shingle = mix((shingle << 1 | shingle >> 63) ^ words[i + j]);
+		}
+		for (int32_t k = 0; k < nhashes; k++) {
+			signature[k] = std::min(signature[k], mix(shingle ^ (0x9e3779b97f4a7c15ULL * (k + 1))));
+		}
+	}
+	for (int32_t b = 0; b < bands; b++) {
+		uint64_t key = b;
+		for (int32_t r = 0; r < ROWS; r++) {
+			key = mix(key ^ signature[b * ROWS + r]);
+		}
+		keys[1 + b] = std::max<uint64_t>(key, 1);
+	}
+	return words.size();
+}
+
+/**
+* @Function: whether a key is in a table.
+*/
+bool Dedup::find(int32_t table, uint64_t key) const {
+	const std::vector<uint64_t>& slots = tables_[table];
+	const size_t mask = slots.size() - 1;
+	for (size_t slot = key & mask; slots[slot] != 0; slot = (slot + 1) & mask) {
+		if (slots[slot] == key) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+* @Function: add a key that is not in the table. a table 3/4 full doubles, at
+*            its largest it takes no more keys and later lines are only
+*            compared to the ones before.
+*/
+void Dedup::insert(int32_t table, uint64_t key) {
+	if (4 * (filled_[table] + 1) > 3 * int64_t(tables_[table].size())) {
+		if (tables_[table].size() >= capacity_) {
+			full_ = true;
+			return;
+		}
+		grow(table);
+	}
+	std::vector<uint64_t>& slots = tables_[table];
+	const size_t mask = slots.size() - 1;
+	size_t slot = key & mask;
+	while (slots[slot] != 0) {
+		slot = (slot + 1) & mask;
+	}
+	slots[slot] = key;
+	filled_[table]++;
+}
+
+/**
+* @Function: double a table and put its keys back.
+*/
+void Dedup::grow(int32_t table) {
+	std::vector<uint64_t> slots(2 * tables_[table].size(), 0);
+	const size_t mask = slots.size() - 1;
+	for (size_t i = 0; i < tables_[table].size(); i++) {
+		const uint64_t key = tables_[table][i];
+		if (key == 0) {
+			continue;
+		}
+		size_t slot = key & mask;
+		while (slots[slot] != 0) {
+			slot = (slot + 1) & mask;
+		}
+		slots[slot] = key;
+	}
+	tables_[table].swap(slots);
+}
+
+/**
+* @Function: copy the lines of in to out without the repeated ones, a batch of
+*            lines is hashed on -thread threads and kept or dropped in order.
+*/
+void Dedup::filter(std::istream& in, std::ostream& out) {
+	TRACE_SCOPE("dedup");
+	const int32_t nkeys = 1 + args_->dedupBands;
+	const int32_t nthreads = std::max(args_->thread, 1);
+	std::vector<std::string> lines;
+	std::vector<uint64_t> keys;
+	std::vector<int32_t> counts;
+	bool more = true;
+	while (more) {
+		lines.resize(BATCH_LINES);
+		size_t n = 0;
+		while (n < BATCH_LINES && std::getline(in, lines[n])) {
+			n++;
+		}
+		more = n == BATCH_LINES;
+		keys.resize(n * nkeys);
+		counts.resize(n);
+		std::vector<std::thread> threads;
+		for (int32_t t = 0; t < nthreads; t++) {
+			threads.push_back(std::thread([&, t]() {
+				for (size_t i = t; i < n; i += nthreads) {
+					counts[i] = hashLine(lines[i], keys.data() + i * nkeys);
+				}
+			}));
+		}
+		for (size_t t = 0; t < threads.size(); t++) {
+			threads[t].join();
+		}
+
+		for (size_t i = 0; i < n; i++) {
+			const uint64_t* key = keys.data() + i * nkeys;
+			lines_++;
+			tokens_ += counts[i];
+			if (counts[i] > 0) {
+				bool drop = false;
+				if (find(0, key[0])) {
+					exact_++;
+					drop = true;
+				} else {
+					for (int32_t b = 1; b < nkeys && !drop; b++) {
+						drop = find(b, key[b]);
+					}
+					if (drop) {
+						near_++;
+					}
+				}
+				if (drop) {
+					removed_ += counts[i];
+					continue;
+				}
+				for (int32_t b = 0; b < nkeys; b++) {
+					insert(b, key[b]);
+				}
+			}
+			out << lines[i] << '\n';
+		}
+		if (args_->verbose > 1) {
+			std::cerr << "\rRead " << lines_ / 1000000 << "M lines" << std::flush;
+		}
+	}
+}
+
+/**
+* @Function: lines and words read and dropped.
+*/
+void Dedup::printInfo() const {
+	std::cerr << std::endl;
+	std::cerr << "Number of lines:  " << lines_ << std::endl;
+	std::cerr << "Exact duplicate lines:  " << exact_ << std::endl;
+	std::cerr << "Near duplicate lines:  " << near_ << std::endl;
+	std::cerr << "Removed " << removed_ << " of " << tokens_ << " words (" << std::fixed << std::setprecision(2)
+		<< (tokens_ > 0 ? 100.0 * removed_ / tokens_ : 0.0) << "%)" << std::endl;
+	if (full_) {
+		std::cerr << "The dedup tables were full, raise -dedupMemory to compare every line with all the lines before it." << std::endl;
+	}
+}
@@ -12,6 +12,12 @@
 #include "real.h"
 #include "alphabet.h"
 #include "Utf.h"
+#include "spacesaving.h"
+#include "lexicon.h"
+#include "random.h"
+#include "corpus.h"
+#include "trace.h"
+#include "utils.h"
 
 #include <random>
 #include <memory>
@@ -21,14 +27,76 @@
 #include <iterator>
 #include <cmath>
 #include <map>
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+
+// identifies a file without reading all of it
+struct FileStamp {
+	int64_t size;
+	int64_t mtime;
+	uint64_t hash;
+};
 
+// words of a part of the corpus in order of first occurrence, the words under
+// threshold are pruned when there are more than limit of them
+struct WordCounts {
+	std::unordered_map<std::string, int32_t> index;
+	std::vector<std::string> words;
+	std::vector<int64_t> counts;
+	int64_t ntokens;
+	int64_t limit;
+	int64_t threshold;
 
-struct entry {
-	std::string word;
-	int64_t count;
-	std::vector<int32_t> subwords;
+	void add(const std::string&);
+	void prune();
 };
 
+void WordCounts::add(const std::string& word) {
+	auto it = index.find(word);
+	if (it == index.end()) {
+		index[word] = words.size();
+		words.push_back(word);
+		counts.push_back(1);
+	} else {
+		counts[it->second]++;
+	}
+	ntokens++;
+	if (int64_t(words.size()) > limit) {
+		prune();
+	}
+}
+
+/**
+* @Function: drop the words seen less than threshold times, raising the
+*            threshold until they fit in limit as alphabet::prune() does.
+*/
+void WordCounts::prune() {
+	while (int64_t(words.size()) > limit) {
+		threshold++;
+		size_t kept = 0;
+		for (size_t i = 0; i < words.size(); i++) {
+			if (counts[i] >= threshold) {
+				words[kept].swap(words[i]);
+				counts[kept] = counts[i];
+				kept++;
+			}
+		}
+		words.resize(kept);
+		counts.resize(kept);
+	}
+	index.clear();
+	for (size_t i = 0; i < words.size(); i++) {
+		index[words[i]] = i;
+	}
+}
+
 //readfeature
 struct  feature{
 	std::string word;
@@ -41,53 +109,76 @@ class Dictionary {
 	  //static const int32_t MAX_VOCAB_SIZE = 100000000;
 	  //static const int32_t MAX_LINE_SIZE = 1000;
 	  static const int32_t MAX_VOCAB_SIZE = 30000000;
-	  static const int32_t MAX_LINE_SIZE = 1024;
 	  
 
 	int32_t findWord(const std::string&) const;
 	void addWord(const std::string&);
 	int32_t findTarget(const std::string&) const;
-	void addTarget(const std::string&, int64_t);
 	int32_t findFeature(const std::string&) const;
 	void addFeature(const std::string&, int64_t);
 
-	void initFeature();
-	void initTargets();
+	void initFeature(int32_t = 0);
 	void initNgrams();
+	void wordNgrams(const std::string&, std::vector<int32_t>&) const;
+	void hashSubwords(const std::string&, std::vector<int32_t>&) const;
+	void hashSubfeat(const std::string&, std::vector<int32_t>&) const;
 
 	void reset(std::istream&) const;
+	void countWords(std::istream&);
+	void countBounded(std::istream&);
+	void countParallel(const std::string&);
+	static void countRanges(const std::vector<CorpusRange>&, WordCounts&, std::atomic<int64_t>&);
+	void importCounts(std::istream&);
 
 	std::shared_ptr<Args> args_;
+	// the words are the targets too, a target id is a word id
 	alphabet words_;
-	//std::vector<entry> wordprops_;
-	std::map<std::string, std::string> featuremap;
-	std::map<std::string, std::string> ::iterator featpos;
+	// feature rows of word i are [subwordOffsets_[i], subwordOffsets_[i + 1]) of subwords_
+	std::vector<int64_t> subwordOffsets_;
+	std::vector<int32_t> subwords_;
+	StrokeLexicon lexicon_;
 	alphabet features_;
-	alphabet targets_;
 	std::vector<real> pdiscard_;
+	// pdiscard_ scaled to 32 bits, a word is kept when a uniform 32 bits draw is <= it
+	std::vector<uint32_t> keep_;
 	int64_t ntokens_;
+	// tokens of the corpus read last, ntokens_ also counts corpora read before
+	int64_t ncorpus_;
 
 public:
+	// getLine trains the first MAX_LINE_SIZE words of a line
+	static const int32_t MAX_LINE_SIZE = 1024;
 	static const std::string EOS;
 	static const std::string BOW;
 	static const std::string EOW;
 
 	explicit Dictionary(std::shared_ptr<Args>);
 
-	std::vector<entry> wordprops_;
+	inline int32_t nsubwords(int32_t id) const {
+		return subwordOffsets_[id + 1] - subwordOffsets_[id];
+	}
+	inline const int32_t* subwords(int32_t id) const {
+		return subwords_.data() + subwordOffsets_[id];
+	}
 
 	int32_t nwords() const;
 	int32_t ntargets() const;
 	int32_t nfeatures() const;
+	int32_t nngrams() const;
+	int64_t ninput() const;
 	int64_t ntokens() const;
+	int64_t ncorpus() const;
+	int64_t memory() const;
 	int32_t getWordId(const std::string&) const;
 	int32_t getTargetId(const std::string&) const;
 	int32_t getFeatureId(const std::string&) const;
 	std::string getWord(int32_t) const;
 	std::string getTarget(int32_t) const;
 	std::string getFeature(int32_t) const;
-	std::string getFeat(std::string);
-	void trim(std::string&);
+	std::string getFeat(const std::string&) const;
+	void getFeat(const std::string&, std::string&) const;
+	void trim(std::string&) const;
+	void getSubwords(const std::string&, std::vector<int32_t>&) const;
 
 	std::vector<int64_t> getCounts() const;
 	void computeSubwords(const std::string&, std::vector<std::string>&) const;
@@ -102,14 +193,26 @@ public:
 	bool discard(int32_t, real) const;
 
 	bool readWord(std::istream&, std::string&) const;
-	void readFeature(std::istream&);
+	void readFeature(const std::string&);
 	void readFromFile(std::istream&);
-	void readFromFile(std::istream&, std::istream&);
+	void readFromFile(std::istream&, const std::string&);
+	void grow(std::istream&);
+	void share(const Dictionary&);
+	void save(std::ostream&) const;
+	void load(std::istream&);
+	bool loadCache(const std::string&);
+	void saveCache(const std::string&) const;
+	static FileStamp stamp(const std::string&);
+	static FileStamp corpusStamp(const std::string&);
 	//int32_t getLine(std::istream&, std::vector<int32_t>&, std::minstd_rand&) const;
-	int32_t getLine(std::istream&, std::vector<std::vector<int32_t> >&, std::vector<std::vector<int32_t> >&, std::vector<int32_t>&, std::minstd_rand&) const;
-	int32_t getLine_zh(std::istream&, std::vector<std::vector<int32_t> >&, std::vector<std::vector<int32_t> >&, std::vector<int32_t>&, std::minstd_rand&) const;
+	int32_t getLine(std::istream&, std::vector<std::vector<int32_t> >&, std::vector<std::vector<int32_t> >&, std::vector<int32_t>&, Random&) const;
+	int32_t getLine(const int32_t*, int32_t, std::vector<std::vector<int32_t> >&, std::vector<std::vector<int32_t> >&, std::vector<int32_t>&, Random&) const;
+	bool readLine(std::istream&, std::vector<int32_t>&) const;
 };
 
+static const int32_t VOCAB_MAGIC_INT32 = 0x62637663;
+static const int32_t VOCAB_VERSION = 2;
+
 const std::string Dictionary::EOS = "</s>";
 const std::string Dictionary::BOW = "<";
 const std::string Dictionary::EOW = ">";
@@ -117,10 +220,9 @@ const std::string Dictionary::EOW = ">";
 /**
 * @Function: initial Dictionary class argument.
 */
-Dictionary::Dictionary(std::shared_ptr<Args> args) : args_(args) {
+Dictionary::Dictionary(std::shared_ptr<Args> args) : args_(args), ntokens_(0), ncorpus_(0) {
 	words_.setCapacity(MAX_VOCAB_SIZE - 1);
 	features_.setCapacity(MAX_VOCAB_SIZE - 1);
-	targets_.setCapacity(MAX_VOCAB_SIZE - 1);
 }
 
 /**
@@ -165,7 +267,7 @@ int32_t Dictionary::nwords() const {
 * @Function: find target Id.
 */
 int32_t Dictionary::findTarget(const std::string& w) const {
-	return targets_.from_string(w);
+	return findWord(w);
 }
 
 /**
@@ -180,22 +282,15 @@ int32_t Dictionary::getTargetId(const std::string& w) const {
 */
 std::string Dictionary::getTarget(int32_t id) const {
 	assert(id >= 0);
-	assert(id < targets_.m_size);
-	return targets_.from_id(id);
-}
-
-/**
-* @Function: add target to alphabet.
-*/
-void Dictionary::addTarget(const std::string& w, int64_t freq) {
-	targets_.add_string(w);
+	assert(id < words_.m_size);
+	return words_.from_id(id);
 }
 
 /**
 * @Function: target count in alphabet.
 */
 int32_t Dictionary::ntargets() const {
-	return targets_.m_size;
+	return words_.m_size;
 }
 
 /**
@@ -225,7 +320,7 @@ std::string Dictionary::getFeature(int32_t id) const {
 * @Function: add feature to alphabet.
 */
 void Dictionary::addFeature(const std::string& w, int64_t freq) {
-	features_.add_string(w);
+	features_.add_string(w, freq);
 }
 
 /**
@@ -236,27 +331,52 @@ int32_t Dictionary::nfeatures() const {
 }
 
 /**
-* @Function: target initial.
+* @Function: rows of ngram features, -bucket when ngrams are hashed.
 */
-void Dictionary::initTargets() {
-	//same as source
-	for (size_t i = 0; i < words_.m_size; i++) {
-		addTarget(words_.from_id(i), words_.m_id_to_freq[i]);
+int32_t Dictionary::nngrams() const {
+	return args_->hash ? args_->bucket : features_.m_size;
+}
+
+/**
+* @Function: rows of the input matrix, words for skipgram and cbow, words and
+*            ngrams for subword, only the ngrams for substoke.
+*/
+int64_t Dictionary::ninput() const {
+	if (args_->model == model_name::substoke) {
+		return nngrams();
+	}
+	if (args_->model == model_name::subword) {
+		return int64_t(nwords()) + nngrams();
 	}
+	return nwords();
 }
 
 /**
 * @Function: feature initial.
 */
-void Dictionary::initFeature() {
+void Dictionary::initFeature(int32_t begin) {
+	TRACE_SCOPE("initFeature");
 	// skipgram and cbow model don't need feature
 	if ((args_->model == model_name::skipgram) || (args_->model == model_name::cbow))
 		return;
-	std::cout << "initail feature, maybe take a while...... " << std::endl;
+	// hashed ngrams need no feature alphabet
+	if (args_->hash)
+		return;
+	std::cerr << "initail feature, maybe take a while...... " << std::endl;
+	// ngrams of a malformed word are cut at its lead bytes
+	int32_t malformed = 0;
+	for (size_t i = begin; i < words_.m_size; i++) {
+		if (!isValidUTF8(words_.from_id(i))) {
+			malformed++;
+		}
+	}
+	if (malformed > 0) {
+		std::cerr << malformed << " words are not valid UTF-8" << std::endl;
+	}
 	//subword for english
 	if (args_->model == model_name::subword) {
 		std::string word;
-		for (size_t i = 0; i < words_.m_size; i++) {
+		for (size_t i = begin; i < words_.m_size; i++) {
 			if (words_.from_id(i) == EOS) word = "<s>";
 			else word = BOW + words_.from_id(i) + EOW;
 			vector<string> ngrams;
@@ -272,7 +392,7 @@ void Dictionary::initFeature() {
 		std::string word;
 		std::string feat;
 		std::string featBE;
-		for (size_t i = 0; i < words_.m_size; i++) {
+		for (size_t i = begin; i < words_.m_size; i++) {
 			word = words_.from_id(i);
 			feat = getFeat(word);
 			if (word == EOS) featBE = "<s>";
@@ -284,13 +404,20 @@ void Dictionary::initFeature() {
 			}
 		}
 	}
-	std::cout << "initail feature finished. " << std::endl;
+	// feature ids of a grown dictionary must stay, only a new one is pruned
+	if (begin == 0 && args_->minCountFeature > 1) {
+		int32_t nfeatures = features_.m_size;
+		features_.prune(args_->minCountFeature);
+		std::cerr << "\nkept " << features_.m_size << " of " << nfeatures
+			<< " features occurring at least " << args_->minCountFeature << " times" << std::endl;
+	}
+	std::cerr << "initail feature finished. " << std::endl;
 }
 
 /**
 * @Function: erase the empty space
 */
-void Dictionary::trim(std::string& s) {
+void Dictionary::trim(std::string& s) const {
 	int index = 0;
 	if (!s.empty())
 	{
@@ -302,72 +429,62 @@ void Dictionary::trim(std::string& s) {
 }
 
 /**
-* @Function: get feature from feature map in dictionary.
+* @Function: get feature from stroke lexicon in dictionary.
 */
-std::string Dictionary::getFeat(std::string word) {
-	std::vector<string> char_vec;
-	getCharactersFromUTF8String(word, char_vec);
+std::string Dictionary::getFeat(const std::string& word) const {
 	std::string feat;
-	//substoke + word
-	//feat += word;
-	for (int i = 0; i < char_vec.size(); i++) {
-		std::string char_str = char_vec[i];
-		//feat += char_str;
-		featpos = featuremap.find(char_str);
-		if (featpos != featuremap.end()) {
-			feat += (*featpos).second;
-		}
-	}
-	trim(feat);
-	if (feat == "") {
+	getFeat(word, feat);
+	return feat;
+}
+
+/**
+* @Function: get feature into feat, feat is reused without allocating.
+*/
+void Dictionary::getFeat(const std::string& word, std::string& feat) const {
+	feat.clear();
+	lexicon_.strokes(word, feat);
+	if (feat.empty()) {
 		//feat = args_->featurepad;
 		feat = word;
 	}
-	return feat;
 }
 
 /**
 * @Function: computer subfeature for chinese character feature, like radaical/stoke.
+*            the ngrams of minn to maxn characters are byte spans of featbe_s.
 */
 void Dictionary::computerSubfeat(const std::string& featbe_s, std::vector<std::string>& substrings) const {
-	std::vector<string> featbe;
-	getCharactersFromUTF8String(featbe_s, featbe);
-	std::string ngram = "";
-	for (size_t i = 0; i < featbe.size(); i++) {
-		for (size_t j = args_->minn; j <= args_->maxn; j++) {
-			if ((i + j) > featbe.size()) 
-				continue;
-			
-			ngram.clear();
-			for (size_t k = i; k <(i + j); k++) {
-				ngram += featbe[k];
+	for (UTF8Iterator begin(featbe_s); !begin.done(); begin.next()) {
+		UTF8Iterator end = begin;
+		for (int32_t n = 1; !end.done() && n <= args_->maxn; n++) {
+			end.next();
+			if (n >= args_->minn) {
+				substrings.push_back(featbe_s.substr(begin.pos(), end.pos() - begin.pos()));
 			}
-			substrings.push_back(ngram);
 		}
 	}
 }
 
 /**
 * @Function: computer subfeature for chinese character feature, like radaical/stoke.
+*            one ngram buffer is reused for the lookups, it only grows.
 */
 void Dictionary::computerSubfeat(const std::string& word_s, std::vector<int32_t>& ngrams) const {
-	std::vector<string> word;
-	getCharactersFromUTF8String(word_s, word);
-	std::string ngram = "";
-	std::vector<int32_t>::iterator it;
-	for (size_t i = 0; i < word.size(); i++) {
-		for (size_t j = args_->minn; j <= args_->maxn; j++) {
-			if ((i + j) > word.size())
-				continue;
-
-			ngram.clear();
-			for (size_t k = i; k <(i + j); k++) {
-				ngram += word[k];
+	if (args_->hash) {
+		hashSubfeat(word_s, ngrams);
+		return;
+	}
+	std::string ngram;
+	for (UTF8Iterator begin(word_s); !begin.done(); begin.next()) {
+		UTF8Iterator end = begin;
+		for (int32_t n = 1; !end.done() && n <= args_->maxn; n++) {
+			end.next();
+			if (n >= args_->minn) {
+				ngram.assign(begin.data(), end.pos() - begin.pos());
+				int32_t h = findFeature(ngram);
+				if (h >= 0)
+					ngrams.push_back(h);
 			}
-			int32_t h = findFeature(ngram);
-			if (h >= 0)
-				//ngrams.push_back(words_.m_size + h);
-				ngrams.push_back(h);
 		}
 	}
 }
@@ -395,15 +512,22 @@ void Dictionary::computeSubwords(const std::string& word, std::vector<std::strin
 * @Function: computer subword for english.
 */
 void Dictionary::computeSubwords(const std::string& word, std::vector<int32_t>& ngrams) const {
+	if (args_->hash) {
+		hashSubwords(word, ngrams);
+		return;
+	}
+	// an ASCII word has one byte per character, only the rest is scanned for continuation bytes
+	const size_t ascii = getASCIIPrefixLength(word.data(), word.size());
+	std::string ngram;
 	for (size_t i = 0; i < word.size(); i++) {
-		std::string ngram;
-		if ((word[i] & 0xC0) == 0x80) continue;
+		if (i >= ascii && (word[i] & 0xC0) == 0x80) continue;
 		for (size_t j = i, n = 1; j < word.size() && n <= args_->maxn; n++) {
-			ngram.push_back(word[j++]);
-			while (j < word.size() && (word[j] & 0xC0) == 0x80) {
-				ngram.push_back(word[j++]);
+			j++;
+			while (j > ascii && j < word.size() && (word[j] & 0xC0) == 0x80) {
+				j++;
 			}
 			if (n >= args_->minn && !(n == 1 && (i == 0 || j == word.size()))) {
+				ngram.assign(word, i, j - i);
 				int32_t h = findFeature(ngram);
 				if (h >= 0)ngrams.push_back(words_.m_size + h);
 			}
@@ -411,6 +535,54 @@ void Dictionary::computeSubwords(const std::string& word, std::vector<int32_t>&
 	}
 }
 
+/**
+* @Function: extend a FNV-1a hash by one byte, an ngram hash is built from the
+*            hash of its prefix so no ngram string is materialized.
+*/
+inline uint32_t hashByte(uint32_t h, char c) {
+	h = h ^ uint32_t(int8_t(c));
+	return h * 16777619;
+}
+
+/**
+* @Function: subword ngram ids hashed into -bucket rows after the words, same ngrams as computeSubwords.
+*/
+void Dictionary::hashSubwords(const std::string& word, std::vector<int32_t>& ngrams) const {
+	for (size_t i = 0; i < word.size(); i++) {
+		if ((word[i] & 0xC0) == 0x80) continue;
+		uint32_t h = 2166136261;
+		for (size_t j = i, n = 1; j < word.size() && n <= args_->maxn; n++) {
+			h = hashByte(h, word[j++]);
+			while (j < word.size() && (word[j] & 0xC0) == 0x80) {
+				h = hashByte(h, word[j++]);
+			}
+			if (n >= args_->minn && !(n == 1 && (i == 0 || j == word.size()))) {
+				ngrams.push_back(words_.m_size + h % args_->bucket);
+			}
+		}
+	}
+}
+
+/**
+* @Function: stroke ngram ids hashed into -bucket rows, same ngrams as computerSubfeat.
+*/
+void Dictionary::hashSubfeat(const std::string& word, std::vector<int32_t>& ngrams) const {
+	for (UTF8Iterator begin(word); !begin.done(); begin.next()) {
+		uint32_t h = 2166136261;
+		UTF8Iterator end = begin;
+		for (int32_t n = 1; !end.done() && n <= args_->maxn; n++) {
+			const char* c = end.data();
+			end.next();
+			for (; c < word.data() + end.pos(); c++) {
+				h = hashByte(h, *c);
+			}
+			if (n >= args_->minn) {
+				ngrams.push_back(h % args_->bucket);
+			}
+		}
+	}
+}
+
 /**
 * @Function: ntokens count.
 */
@@ -419,63 +591,91 @@ int64_t Dictionary::ntokens() const {
 }
 
 /**
-* @Function: Ngrams initial.
+* @Function: ntokens count of the corpus read last.
 */
-void Dictionary::initNgrams() {
-	wordprops_.resize(words_.m_size);
+int64_t Dictionary::ncorpus() const {
+	return ncorpus_;
+}
 
-	std::cout << "initail Ngrams feature, maybe take a while...... " << std::endl;
+/**
+* @Function: bytes of the words, the features and the subword rows of the words.
+*/
+int64_t Dictionary::memory() const {
+	return words_.memory() + features_.memory()
+		+ subwordOffsets_.capacity() * sizeof(int64_t) + subwords_.capacity() * sizeof(int32_t);
+}
 
-	if ((args_->model == model_name::skipgram) || (args_->model == model_name::cbow)) {
-		for (size_t i = 0; i < words_.m_size; i++) {
-			wordprops_[i].word = words_.from_id(i);
-			wordprops_[i].count = words_.m_id_to_freq[i];
-
-			std::string word = (BOW + wordprops_[i].word + EOW);
-			wordprops_[i].subwords.clear();
-			if (wordprops_[i].word != EOS) {
-				computeSubwords(word, wordprops_[i].subwords);
-			}
+/**
+* @Function: Ngrams initial.
+*/
+void Dictionary::initNgrams() {
+	TRACE_SCOPE("initNgrams");
+	subwordOffsets_.assign(1, 0);
+	subwords_.clear();
+	subwordOffsets_.reserve(words_.m_size + 1);
+
+	std::cerr << "initail Ngrams feature, maybe take a while...... " << std::endl;
+
+	// skipgram and cbow train the word rows only, their words have no subwords
+	std::vector<int32_t> ngrams;
+	for (int32_t i = 0; i < words_.m_size; i++) {
+		if ((args_->model == model_name::subword) || (args_->model == model_name::substoke)) {
+			ngrams.clear();
+			wordNgrams(words_.from_id(i), ngrams);
+			subwords_.insert(subwords_.end(), ngrams.begin(), ngrams.end());
 		}
+		subwordOffsets_.push_back(subwords_.size());
 	}
+	subwords_.shrink_to_fit();
+	std::cerr << "initail Ngrams feature finished. " << std::endl;
+}
 
+/**
+* @Function: feature ids of any word, subword for subword model, stroke ngram for substoke.
+*/
+void Dictionary::wordNgrams(const std::string& word, std::vector<int32_t>& ngrams) const {
 	if (args_->model == model_name::subword) {
-		std::string word;
-		for (size_t i = 0; i < words_.m_size; i++) {
-			wordprops_[i].word = words_.from_id(i);
-			wordprops_[i].count = words_.m_id_to_freq[i];
-			if (wordprops_[i].word == EOS) 
-				word = "<s>";
-			else word = (BOW + wordprops_[i].word + EOW);
-			wordprops_[i].subwords.clear();
-			computeSubwords(word, wordprops_[i].subwords);
+		if (word == EOS)
+			computeSubwords("<s>", ngrams);
+		else computeSubwords(BOW + word + EOW, ngrams);
+	} else if (args_->model == model_name::substoke) {
+		if (word == EOS)
+			computerSubfeat("<s>", ngrams);
+		else {
+			std::string feat;
+			getFeat(word, feat);
+			computerSubfeat(BOW + feat + EOW, ngrams);
 		}
 	}
+}
 
-	// substoke ngram
-	if (args_->model == model_name::substoke) {
-		std::string featBE;
-		for (size_t i = 0; i < words_.m_size; i++) {
-			wordprops_[i].word = words_.from_id(i);
-			wordprops_[i].count = words_.m_id_to_freq[i];
-			std::string feat = getFeat(wordprops_[i].word);
-			if (wordprops_[i].word == EOS) featBE = "<s>";
-			else featBE = BOW + feat + EOW;
-			wordprops_[i].subwords.clear();
-			computerSubfeat(featBE, wordprops_[i].subwords);
-		}
+/**
+* @Function: rows whose average is the vector of a word, out of vocabulary words
+*            only have rows in subword and substoke model.
+*/
+void Dictionary::getSubwords(const std::string& word, std::vector<int32_t>& ngrams) const {
+	ngrams.clear();
+	int32_t wid = findWord(word);
+	if ((args_->model == model_name::skipgram) || (args_->model == model_name::cbow)) {
+		if (wid >= 0) ngrams.push_back(wid);
+	} else if (wid >= 0) {
+		ngrams.assign(subwords(wid), subwords(wid) + nsubwords(wid));
+	} else {
+		wordNgrams(word, ngrams);
 	}
-	std::cout << "initail Ngrams feature finished. " << std::endl;
 }
 
 /**
 * @Function: TableDiscard initial.
 */
 void Dictionary::initTableDiscard() {
+	TRACE_SCOPE("initTableDiscard");
 	pdiscard_.resize(words_.m_size);
+	keep_.resize(words_.m_size);
 	for (size_t i = 0; i < words_.m_size; i++) {
 		real f = real(words_.m_id_to_freq[i]) / real(ntokens_);
 		pdiscard_[i] = std::sqrt(args_->t / f) + args_->t / f;
+		keep_[i] = pdiscard_[i] >= 1.0 ? UINT32_MAX : uint32_t(double(pdiscard_[i]) * 4294967296.0);
 	}
 }
 
@@ -493,11 +693,12 @@ bool Dictionary::discard(int32_t id, real rand) const {
 * @Function: read word.
 */
 bool Dictionary::readWord(std::istream& in, std::string& word) const {
+	TRACE_SCOPE("readWord");
 	char c;
 	std::streambuf& sb = *in.rdbuf();
 	word.clear();
 	while ((c = sb.sbumpc()) != EOF) {
-		if (c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f' || c == '\0') {
+		if (utils::isSpace(c)) {
 			if (word.empty()) {
 				if (c == '\n') {
 					word += EOS;
@@ -519,9 +720,29 @@ bool Dictionary::readWord(std::istream& in, std::string& word) const {
 }
 
 /**
-* @Function: read file.
+* @Function: count all words of the corpus into words_.
 */
-void Dictionary::readFromFile(std::istream& in) {
+void Dictionary::countWords(std::istream& in) {
+	TRACE_SCOPE("countWords");
+	if (args_->vocabCounts != "") {
+		std::ifstream ifs(args_->vocabCounts);
+		if (!ifs.is_open()) {
+			throw std::invalid_argument(args_->vocabCounts + " cannot be opened for loading word counts!");
+		}
+		importCounts(ifs);
+		ifs.close();
+		return;
+	}
+	if (args_->vocabMemory > 0) {
+		countBounded(in);
+		return;
+	}
+	// a corpus of files can be split over the threads, other streams are read in one pass
+	Corpus* corpus = dynamic_cast<Corpus*>(&in);
+	if (args_->thread > 1 && corpus != NULL && corpus->input() != "" && corpus->input() != "-") {
+		countParallel(corpus->input());
+		return;
+	}
 	std::string word;
 	ntokens_ = 0;
 	int64_t	minThreshold = 1;
@@ -536,13 +757,196 @@ void Dictionary::readFromFile(std::istream& in) {
 			words_.prune(minThreshold);
 		}
 	}
+}
+
+/**
+* @Function: count the parts of Corpus::partition() on -thread threads, the
+*            parts are merged in order so the words keep their order of first
+*            occurrence as in a single pass. a part keeps at most its share of
+*            0.75 * MAX_VOCAB_SIZE words, pruned like words_ in a single pass.
+*/
+void Dictionary::countParallel(const std::string& input) {
+	std::vector<std::vector<CorpusRange> > parts = Corpus::partition(input, args_->thread);
+	std::vector<WordCounts> counts(parts.size());
+	std::atomic<int64_t> read(0);
+	std::atomic<int32_t> running(parts.size());
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < parts.size(); i++) {
+		counts[i].ntokens = 0;
+		counts[i].limit = 0.75 * MAX_VOCAB_SIZE / parts.size();
+		counts[i].threshold = 1;
+		threads.push_back(std::thread([&, i]() {
+			countRanges(parts[i], counts[i], read);
+			running--;
+		}));
+	}
+	int64_t shown = 0;
+	while (running > 0) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		if (args_->verbose > 1 && read / 1000000 > shown) {
+			shown = read / 1000000;
+			std::cerr << "\rRead " << shown << "M words" << std::flush;
+		}
+	}
+	for (size_t i = 0; i < threads.size(); i++) {
+		threads[i].join();
+	}
+	ntokens_ = 0;
+	int64_t	minThreshold = 1;
+	for (size_t i = 0; i < counts.size(); i++) {
+		for (size_t j = 0; j < counts[i].words.size(); j++) {
+			words_.add_string(counts[i].words[j], counts[i].counts[j]);
+			if (words_.m_size > 0.75 * MAX_VOCAB_SIZE) {
+				minThreshold++;
+				words_.prune(minThreshold);
+			}
+		}
+		ntokens_ += counts[i].ntokens;
+		WordCounts().index.swap(counts[i].index);
+		std::vector<std::string>().swap(counts[i].words);
+		std::vector<int64_t>().swap(counts[i].counts);
+	}
+	if (args_->verbose > 1) {
+		std::cerr << "\rRead " << ntokens_ / 1000000 << "M words" << std::flush;
+	}
+}
+
+/**
+* @Function: count the lines starting in the ranges, a range not at the start
+*            of its file skips the line it begins in. tokens are split by
+*            utils::nextWord() as in readWord(), with an EOS for every newline.
+*            read is advanced every 64K tokens for the progress.
+*/
+void Dictionary::countRanges(const std::vector<CorpusRange>& ranges, WordCounts& counts, std::atomic<int64_t>& read) {
+	TRACE_SCOPE("countRanges");
+	const int64_t STEP = 1 << 16;
+	std::string line, word;
+	auto add = [&](const std::string& w) {
+		counts.add(w);
+		if (counts.ntokens % STEP == 0) {
+			read += STEP;
+		}
+	};
+	for (size_t r = 0; r < ranges.size(); r++) {
+		const CorpusRange& range = ranges[r];
+		std::unique_ptr<std::streambuf> buf = Corpus::open(range.path);
+		if (!buf) {
+			throw std::invalid_argument(range.path + " cannot be opened for training!");
+		}
+		std::istream in(buf.get());
+		int64_t pos = 0;
+		if (range.begin > 0) {
+			in.seekg(std::streampos(range.begin - 1));
+			std::getline(in, line);
+			pos = range.begin + line.size();
+		}
+		while ((range.end < 0 || pos < range.end) && std::getline(in, line)) {
+			const bool newline = !in.eof();
+			pos += line.size() + (newline ? 1 : 0);
+			size_t i = 0, begin;
+			while (utils::nextWord(line, i, begin)) {
+				word.assign(line, begin, i - begin);
+				add(word);
+			}
+			if (newline) {
+				add(EOS);
+			}
+		}
+		if (range.separator) {
+			add(EOS);
+		}
+	}
+}
+
+/**
+* @Function: count words in -vocabMemory MB, a Space-Saving pass finds the words
+*            which may reach minCount, a second pass counts only those exactly.
+*/
+void Dictionary::countBounded(std::istream& in) {
+	TRACE_SCOPE("countBounded");
+	// a counter costs its string, its hash node and its heap slot, about 128 bytes
+	const size_t capacity = size_t(args_->vocabMemory) * 1024 * 1024 / 128;
+	SpaceSaving counter(capacity);
+	std::string word;
+	ntokens_ = 0;
+	while (readWord(in, word)) {
+		counter.add(word);
+		ntokens_++;
+		if (ntokens_ % 1000000 == 0 && args_->verbose > 1) {
+			std::cerr << "\rRead " << ntokens_ / 1000000 << "M words" << std::flush;
+		}
+	}
+	std::vector<std::string> candidates;
+	counter.candidates(args_->minCount, candidates);
+	if (args_->verbose > 0) {
+		std::cerr << "\rSpace-Saving: " << counter.size() << " counters, " << candidates.size()
+			<< " candidates, overestimate at most " << counter.minCount() << std::endl;
+	}
+	if (counter.minCount() >= args_->minCount) {
+		std::cerr << "Warning: -vocabMemory is too small, words with less than "
+			<< counter.minCount() << " occurrences may be missing." << std::endl;
+	}
+
+	std::unordered_map<std::string, int64_t> exact;
+	exact.reserve(candidates.size());
+	for (size_t i = 0; i < candidates.size(); i++) {
+		exact[candidates[i]] = 0;
+	}
+	std::vector<std::string>().swap(candidates);
+	in.clear();
+	in.seekg(std::streampos(0));
+	while (readWord(in, word)) {
+		auto it = exact.find(word);
+		if (it != exact.end()) {
+			it->second++;
+		}
+	}
+	for (auto it = exact.cbegin(); it != exact.cend(); ++it) {
+		words_.add_string(it->first, it->second);
+	}
+}
+
+/**
+* @Function: take the counts of "word count" lines instead of counting the corpus,
+*            ntokens is the sum of the counts.
+*/
+void Dictionary::importCounts(std::istream& in) {
+	std::string line, word;
+	int64_t count;
+	int64_t	minThreshold = 1;
+	ntokens_ = 0;
+	while (std::getline(in, line)) {
+		std::stringstream fields(line);
+		if (!(fields >> word >> count) || count <= 0) {
+			if (!line.empty()) {
+				std::cerr << "Warning " << line << std::endl;
+			}
+			continue;
+		}
+		words_.add_string(word, count);
+		ntokens_ += count;
+		if (words_.m_size > 0.75 * MAX_VOCAB_SIZE) {
+			minThreshold++;
+			words_.prune(minThreshold);
+		}
+	}
+}
+
+/**
+* @Function: read file.
+*/
+void Dictionary::readFromFile(std::istream& in) {
+	countWords(in);
 	int64_t words = words_.m_size;
-	words_.prune(args_->minCount);
+	{
+		TRACE_SCOPE("prune");
+		words_.prune(args_->minCount);
+	}
 
 	initFeature();
-	initTargets();
 	initNgrams();
 	initTableDiscard();
+	ncorpus_ = ntokens_;
 
 	if (args_->verbose > 0) {
 		std::cerr << "\rRead " << ntokens_ / 1000000 << "M words" << std::endl;
@@ -550,7 +954,8 @@ void Dictionary::readFromFile(std::istream& in) {
 		std::cerr << "Number of all words:  " << words << std::endl;
 		std::cerr << "Number of words:  " << words_.m_size << std::endl;
 		std::cerr << "Number of features: " << features_.m_size << std::endl;
-		std::cerr << "Number of targets: " << targets_.m_size << std::endl;
+		std::cerr << "Number of targets: " << ntargets() << std::endl;
+		std::cerr << "Vocabulary: " << memory() / (1024 * 1024) << "MB" << std::endl;
 	}
 	if (words_.m_size == 0) {
 		throw std::invalid_argument("Empty vocabulary. Check the input file Or Try a smaller -minCount value.");
@@ -560,33 +965,23 @@ void Dictionary::readFromFile(std::istream& in) {
 /**
 * @Function: read file.
 */
-void Dictionary::readFromFile(std::istream& in, std::istream& infeature) {
-	std::string word;
-	ntokens_ = 0;
-	int64_t	minThreshold = 1;
-	while (readWord(in, word)) {
-		addWord(word);
-		ntokens_++;
-		if (ntokens_ % 1000000 == 0 && args_->verbose > 1) {
-			std::cerr << "\rRead " << ntokens_ / 1000000 << "M words" << std::flush;
-		}
-		if (words_.m_size > 0.75 * MAX_VOCAB_SIZE) {
-			minThreshold++;
-			words_.prune(minThreshold);
-		}
-	}
+void Dictionary::readFromFile(std::istream& in, const std::string& infeature) {
+	countWords(in);
 
 	int64_t words = words_.m_size;
-	words_.prune(args_->minCount);
+	{
+		TRACE_SCOPE("prune");
+		words_.prune(args_->minCount);
+	}
 
 	//read feature file
 	readFeature(infeature);
 
 	// initial feature and ngram
 	initFeature();
-	initTargets();
 	initNgrams();
 	initTableDiscard();
+	ncorpus_ = ntokens_;
 
 	if (args_->verbose > 0) {
 		std::cerr << "\rRead " << ntokens_ / 1000000 << "M words" << std::endl;
@@ -594,7 +989,8 @@ void Dictionary::readFromFile(std::istream& in, std::istream& infeature) {
 		std::cerr << "Number of all words:  " << words << std::endl;
 		std::cerr << "Number of words:  " << words_.m_size << std::endl;
 		std::cerr << "Number of features: " << features_.m_size << std::endl;
-		std::cerr << "Number of targets: " << targets_.m_size << std::endl;
+		std::cerr << "Number of targets: " << ntargets() << std::endl;
+		std::cerr << "Vocabulary: " << memory() / (1024 * 1024) << "MB" << std::endl;
 	}
 	if (words_.m_size == 0) {
 		throw std::invalid_argument("Empty vocabulary. Check the input file Or Try a smaller -minCount value.");
@@ -602,26 +998,254 @@ void Dictionary::readFromFile(std::istream& in, std::istream& infeature) {
 }
 
 /**
-* @Function: read feature file.
+* @Function: count a new corpus into the dictionary, known words keep their id and
+*            add the new counts, new words and their features get the next ids.
 */
-void Dictionary::readFeature(std::istream& infeature) {
-	std::string line;
+void Dictionary::grow(std::istream& in) {
+	TRACE_SCOPE("grow");
+	alphabet fresh;
+	fresh.setCapacity(MAX_VOCAB_SIZE - 1);
 	std::string word;
-	std::string feat;
-	featuremap.clear();
-	while (std::getline(infeature, line)){
-		//std::cout << line << std::endl;
-		int pos = line.find_first_of(' ');
-		if (pos == -1) {
-			std::cerr << "Warning " << line << std::endl;
-			continue;
+	int64_t ntokens = 0;
+	int64_t	minThreshold = 1;
+	while (readWord(in, word)) {
+		fresh.add_string(word);
+		ntokens++;
+		if (ntokens % 1000000 == 0 && args_->verbose > 1) {
+			std::cerr << "\rRead " << ntokens / 1000000 << "M words" << std::flush;
+		}
+		if (fresh.m_size > 0.75 * MAX_VOCAB_SIZE) {
+			minThreshold++;
+			fresh.prune(minThreshold);
 		}
-		word = line.substr(0, pos);
-		feat = line.substr(pos + 1);
-		//std::cout << word << " && " << feat << std::endl;
-		featuremap[word] = feat;
 	}
-	std::cerr << "\nfeaturemap size	" << featuremap.size() << std::endl;
+
+	int32_t nwords = words_.m_size;
+	int32_t nfeatures = features_.m_size;
+	for (int32_t i = 0; i < fresh.m_size; i++) {
+		std::string w = fresh.from_id(i);
+		if (findWord(w) >= 0 || fresh.m_id_to_freq[i] >= args_->minCount) {
+			words_.add_string(w, fresh.m_id_to_freq[i]);
+		}
+	}
+	ntokens_ += ntokens;
+	ncorpus_ = ntokens;
+
+	initFeature(nwords);
+	initNgrams();
+	initTableDiscard();
+
+	if (args_->verbose > 0) {
+		std::cerr << "\rRead " << ntokens / 1000000 << "M words" << std::endl;
+		std::cerr << "Number of new words:  " << words_.m_size - nwords << std::endl;
+		std::cerr << "Number of new features: " << features_.m_size - nfeatures << std::endl;
+		std::cerr << "Number of words:  " << words_.m_size << std::endl;
+		std::cerr << "Number of features: " << features_.m_size << std::endl;
+	}
+}
+
+/**
+* @Function: take the counted words of another dictionary, the features, subword
+*            rows and discard table are built for the model of this one. the
+*            targets are the words, a target id is a word id.
+*/
+void Dictionary::share(const Dictionary& counted) {
+	words_ = counted.words_;
+	ntokens_ = counted.ntokens_;
+	ncorpus_ = counted.ncorpus_;
+	if (args_->model == model_name::substoke) {
+		readFeature(args_->infeature);
+	}
+	initFeature();
+	initNgrams();
+	initTableDiscard();
+
+	if (args_->verbose > 0) {
+		std::cerr << "Number of words:  " << words_.m_size << std::endl;
+		std::cerr << "Number of features: " << features_.m_size << std::endl;
+	}
+}
+
+/**
+* @Function: save words, features and the stroke lexicon.
+*/
+void Dictionary::save(std::ostream& out) const {
+	out.write((char*)&ntokens_, sizeof(int64_t));
+	const alphabet* alphabets[2] = { &words_, &features_ };
+	for (int32_t a = 0; a < 2; a++) {
+		int32_t size = alphabets[a]->m_size;
+		out.write((char*)&size, sizeof(int32_t));
+		for (int32_t i = 0; i < size; i++) {
+			out.write(alphabets[a]->data(i), alphabets[a]->length(i) * sizeof(char));
+			out.put(0);
+			out.write((char*)&alphabets[a]->m_id_to_freq[i], sizeof(int64_t));
+		}
+	}
+	lexicon_.save(out);
+}
+
+/**
+* @Function: load a dictionary written by save().
+*/
+void Dictionary::load(std::istream& in) {
+	words_.clear();
+	features_.clear();
+	in.read((char*)&ntokens_, sizeof(int64_t));
+	ncorpus_ = ntokens_;
+	alphabet* alphabets[2] = { &words_, &features_ };
+	std::string w;
+	for (int32_t a = 0; a < 2; a++) {
+		int32_t size = 0;
+		in.read((char*)&size, sizeof(int32_t));
+		for (int32_t i = 0; i < size; i++) {
+			int64_t freq = 0;
+			std::getline(in, w, '\0');
+			in.read((char*)&freq, sizeof(int64_t));
+			alphabets[a]->add_string(w, freq);
+		}
+	}
+	lexicon_.read(in);
+	if (!in) {
+		throw std::invalid_argument("Dictionary is truncated or corrupted.");
+	}
+	initNgrams();
+	initTableDiscard();
+}
+
+/**
+* @Function: size, mtime and a FNV-1a hash of the first, middle and last MB of a file.
+*/
+FileStamp Dictionary::stamp(const std::string& path) {
+	FileStamp st = { -1, -1, 14695981039346656037ULL };
+	struct stat info;
+	if (path == "" || ::stat(path.c_str(), &info) != 0) {
+		return st;
+	}
+	st.size = info.st_size;
+	st.mtime = info.st_mtime;
+	std::ifstream ifs(path, std::ifstream::binary);
+	const int64_t block = 1 << 20;
+	const int64_t offsets[3] = { 0, std::max<int64_t>(0, st.size / 2 - block / 2), std::max<int64_t>(0, st.size - block) };
+	std::vector<char> buffer(block);
+	for (int32_t k = 0; k < 3; k++) {
+		ifs.clear();
+		ifs.seekg(std::streampos(offsets[k]));
+		ifs.read(buffer.data(), block);
+		for (std::streamsize i = 0; i < ifs.gcount(); i++) {
+			st.hash = (st.hash ^ uint8_t(buffer[i])) * 1099511628211ULL;
+		}
+	}
+	return st;
+}
+
+/**
+* @Function: stamp of every file of a corpus combined, one file keeps its own stamp.
+*/
+FileStamp Dictionary::corpusStamp(const std::string& input) {
+	std::vector<std::string> files = Corpus::expand(input);
+	if (files.size() == 1 && files[0] == input) {
+		return stamp(input);
+	}
+	FileStamp st = { 0, 0, 14695981039346656037ULL };
+	for (size_t i = 0; i < files.size(); i++) {
+		FileStamp file = stamp(files[i]);
+		st.size += file.size;
+		st.mtime = std::max(st.mtime, file.mtime);
+		for (size_t k = 0; k < files[i].size(); k++) {
+			st.hash = (st.hash ^ uint8_t(files[i][k])) * 1099511628211ULL;
+		}
+		st.hash = (st.hash ^ file.hash) * 1099511628211ULL;
+	}
+	return st;
+}
+
+/**
+* @Function: load a dictionary written by saveCache(), false if there is none or
+*            the corpus, the feature file or the dictionary arguments changed.
+*/
+bool Dictionary::loadCache(const std::string& path) {
+	TRACE_SCOPE("loadCache");
+	std::ifstream ifs(path, std::ifstream::binary);
+	if (!ifs.is_open()) {
+		return false;
+	}
+	int32_t magic = 0, version = 0;
+	ifs.read((char*)&magic, sizeof(int32_t));
+	ifs.read((char*)&version, sizeof(int32_t));
+	if (magic != VOCAB_MAGIC_INT32 || version != VOCAB_VERSION) {
+		std::cerr << path << " is not a vocabulary cache, counting the corpus." << std::endl;
+		return false;
+	}
+	FileStamp corpus, feature;
+	int32_t params[7];
+	ifs.read((char*)&corpus, sizeof(FileStamp));
+	ifs.read((char*)&feature, sizeof(FileStamp));
+	ifs.read((char*)params, sizeof(params));
+	FileStamp expected = args_->vocabCounts != "" ? stamp(args_->vocabCounts) : corpusStamp(args_->input);
+	FileStamp expectedFeature = stamp(args_->infeature);
+	int32_t expectedParams[7] = { args_->minCount, args_->minn, args_->maxn, int32_t(args_->model), args_->hash, args_->bucket, args_->minCountFeature };
+	// stdin has no stamp, the cache is taken as its prebuilt dictionary
+	const bool stamped = args_->input != "-";
+	std::string reason;
+	if (!ifs) {
+		reason = "it is truncated";
+	} else if (stamped && std::memcmp(&corpus, &expected, sizeof(FileStamp)) != 0) {
+		reason = "the corpus changed";
+	} else if (std::memcmp(&feature, &expectedFeature, sizeof(FileStamp)) != 0) {
+		reason = "the feature file changed";
+	} else if (std::memcmp(params, expectedParams, sizeof(params)) != 0) {
+		reason = "-minCount, -minCountFeature, -minn, -maxn, the model, -hash or -bucket changed";
+	}
+	if (reason != "") {
+		std::cerr << "Vocabulary cache " << path << " is stale, " << reason << ", counting the corpus." << std::endl;
+		return false;
+	}
+	load(ifs);
+	ifs.close();
+	if (args_->verbose > 0) {
+		std::cerr << "Loaded vocabulary cache " << path << std::endl;
+		std::cerr << "Number of all words:  " << ntokens_ << std::endl;
+		std::cerr << "Number of words:  " << words_.m_size << std::endl;
+		std::cerr << "Number of features: " << features_.m_size << std::endl;
+		std::cerr << "Number of targets: " << ntargets() << std::endl;
+		std::cerr << "Vocabulary: " << memory() / (1024 * 1024) << "MB" << std::endl;
+	}
+	return true;
+}
+
+/**
+* @Function: save the dictionary with the stamps of what it was built from, the
+*            file is written aside and renamed so readers never see half of it.
+*/
+void Dictionary::saveCache(const std::string& path) const {
+	TRACE_SCOPE("saveCache");
+	std::string tmp = path + ".tmp";
+	std::ofstream ofs(tmp, std::ofstream::binary);
+	if (!ofs.is_open()) {
+		throw std::invalid_argument(tmp + " cannot be opened for saving the vocabulary.");
+	}
+	FileStamp corpus = args_->vocabCounts != "" ? stamp(args_->vocabCounts) : corpusStamp(args_->input);
+	FileStamp feature = stamp(args_->infeature);
+	int32_t params[7] = { args_->minCount, args_->minn, args_->maxn, int32_t(args_->model), args_->hash, args_->bucket, args_->minCountFeature };
+	ofs.write((char*)&VOCAB_MAGIC_INT32, sizeof(int32_t));
+	ofs.write((char*)&VOCAB_VERSION, sizeof(int32_t));
+	ofs.write((char*)&corpus, sizeof(FileStamp));
+	ofs.write((char*)&feature, sizeof(FileStamp));
+	ofs.write((char*)params, sizeof(params));
+	save(ofs);
+	ofs.close();
+	if (!ofs || std::rename(tmp.c_str(), path.c_str()) != 0) {
+		throw std::runtime_error(path + " cannot be written.");
+	}
+}
+
+/**
+* @Function: read feature file, text or compiled by compile-feature.
+*/
+void Dictionary::readFeature(const std::string& infeature) {
+	TRACE_SCOPE("readFeature");
+	lexicon_.load(infeature);
+	std::cerr << "\nfeaturemap size	" << lexicon_.size() << std::endl;
 }
 
 /**
@@ -638,61 +1262,79 @@ void Dictionary::reset(std::istream& in) const {
 * @Function: getCounts.
 */
 std::vector<int64_t> Dictionary::getCounts() const {
-	std::vector<int64_t> counts;
-	for (int i = 0; i < wordprops_.size(); i++) {
-		counts.push_back(wordprops_[i].count);
+	return words_.m_id_to_freq;
+}
+
+/**
+* @Function: word ids of the next line, -1 for a word out of the vocabulary.
+*            false at the end of the stream.
+*/
+bool Dictionary::readLine(std::istream& in, std::vector<int32_t>& words) const {
+	std::string token;
+	bool read = false;
+	while (readWord(in, token)) {
+		read = true;
+		if (token == EOS)
+			break;
+		words.push_back(findWord(token));
 	}
-	return counts;
+	return read;
 }
 
 /**
 * @Function: getLine.
 */
 int32_t Dictionary::getLine(std::istream& in, std::vector<std::vector<int32_t> >& sourceTypes,
-	std::vector<std::vector<int32_t> >& sources, std::vector<int32_t>& targets, std::minstd_rand& rng) const {
-	std::uniform_real_distribution<> uniform(0, 1);
-	std::string token;
-	vector<string> words;
-	int32_t ntokens = 0;
-
+	std::vector<std::vector<int32_t> >& sources, std::vector<int32_t>& targets, Random& rng) const {
+	TRACE_SCOPE("getLine");
+	std::vector<int32_t> words;
 	reset(in);
+	readLine(in, words);
+	return getLine(words.data(), words.size(), sourceTypes, sources, targets, rng);
+}
+
+/**
+* @Function: the sources and targets of a line of word ids, a target id is its
+*            word id.
+*/
+int32_t Dictionary::getLine(const int32_t* words, int32_t word_num, std::vector<std::vector<int32_t> >& sourceTypes,
+	std::vector<std::vector<int32_t> >& sources, std::vector<int32_t>& targets, Random& rng) const {
+	int32_t ntokens = 0;
 	sourceTypes.clear();
 	sources.clear();
 	targets.clear();
-	words.clear();
-	while (readWord(in, token)) {
-		if (token == EOS)
-			break;
-		words.push_back(token);
-	}
 
-	int word_num = words.size();
+	// subsampling and the subwords, up to the end of the line
+	TRACE_SCOPE("subsample");
 	int valid = 0;
+	const uint32_t* uniform = rng.uniform32(word_num);
 	
 	for (int i = 0; i < word_num; i++) {
-		int32_t wid = findWord(words[i]);
-		int32_t tid = findTarget(words[i]);
+		int32_t wid = words[i];
+		int32_t tid = wid;
 		ntokens++;
-		if (wid < 0 || tid < 0 || discard(wid, uniform(rng)))
+		if (wid < 0 || tid < 0 || uniform[i] > keep_[wid])
 			continue;
 		valid++;
 		sourceTypes.push_back(std::vector<int32_t>());
 		sources.push_back(std::vector<int32_t>());
-		sourceTypes[valid - 1].push_back(0);
-		sources[valid - 1].push_back(wid);
 		targets.push_back(tid);
+		// substoke input rows are only its stroke n-grams
+		if (args_->model != model_name::substoke) {
+			sourceTypes[valid - 1].push_back(0);
+			sources[valid - 1].push_back(wid);
+		}
 
 		if (ntokens > MAX_LINE_SIZE) break;
 
 		if ((args_->model == model_name::skipgram) || (args_->model == model_name::cbow))
 			continue;
 
-		//sources[valid - 1].pop_back();
-		
-		int ngrams_count = wordprops_[wid].subwords.size();
+		const int32_t* ngrams = subwords(wid);
+		int ngrams_count = nsubwords(wid);
 		for (int j = 0; j < ngrams_count; j++) {
 			sourceTypes[valid - 1].push_back(0);
-			sources[valid - 1].push_back(wordprops_[wid].subwords[j]);
+			sources[valid - 1].push_back(ngrams[j]);
 		}
 	}
 	return ntokens;
@@ -0,0 +1,384 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: distributed.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: data-parallel training over TCP, workers periodically average
+*            the sparse deltas of the rows they touched. rank 0 is the reducer.
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_map>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "args.h"
+#include "matrix.h"
+#include "real.h"
+
+//sparse rows of one matrix, ids[k] owns values[k * dim, (k + 1) * dim)
+struct SparseRows {
+	std::vector<int32_t> ids;
+	std::vector<real> values;
+};
+
+class Distributed {
+  protected:
+	std::shared_ptr<Args> args_;
+	std::vector<std::shared_ptr<Matrix> > mats_;
+	std::vector<std::vector<real> > snapshots_;
+	// rank 0 keeps one socket per peer, other ranks keep peers_[0] only
+	std::vector<int> peers_;
+	int64_t rounds_;
+	int64_t round_;
+	int64_t rowsSent_;
+	int64_t bytesSent_;
+
+	void listenPeers(int32_t);
+	void connectMaster(const std::string&, int32_t);
+	void sendAll(int, const void*, size_t);
+	void recvAll(int, void*, size_t);
+	void sendRows(int, const SparseRows&);
+	void recvRows(int, SparseRows&, int64_t);
+	void handshake();
+
+	void capture(int32_t, SparseRows&);
+	void reduce(const std::vector<SparseRows>&, int32_t, SparseRows&) const;
+	void apply(int32_t, const SparseRows&, const SparseRows&);
+	void sync();
+
+  public:
+	Distributed(std::shared_ptr<Args>, std::shared_ptr<Matrix>, std::shared_ptr<Matrix>);
+	~Distributed();
+
+	void start(int64_t);
+	void step(real);
+	void finish();
+	void printInfo(std::ostream&) const;
+};
+
+/**
+* @Function: initial Distributed class, snapshot the matrices and track rows.
+*/
+Distributed::Distributed(std::shared_ptr<Args> args, std::shared_ptr<Matrix> input,
+	std::shared_ptr<Matrix> output) : args_(args) {
+	mats_.push_back(input);
+	mats_.push_back(output);
+	for (size_t m = 0; m < mats_.size(); m++) {
+		const Matrix& mat = *mats_[m];
+		snapshots_.push_back(std::vector<real>(mat.data(), mat.data() + mat.rows() * mat.cols()));
+		mats_[m]->trackRows();
+	}
+	rounds_ = 1;
+	round_ = 0;
+	rowsSent_ = 0;
+	bytesSent_ = 0;
+}
+
+Distributed::~Distributed() {
+	for (size_t i = 0; i < peers_.size(); i++) {
+		if (peers_[i] >= 0) close(peers_[i]);
+	}
+}
+
+/**
+* @Function: connect all workers, then sync every ntokens / syncRate tokens.
+*/
+void Distributed::start(int64_t ntokens) {
+	std::string host = args_->master;
+	int32_t port = 23456;
+	size_t pos = host.find_last_of(':');
+	if (pos != std::string::npos) {
+		port = std::stoi(host.substr(pos + 1));
+		host = host.substr(0, pos);
+	}
+	if (args_->rank == 0) {
+		listenPeers(port);
+	} else {
+		connectMaster(host, port);
+	}
+	handshake();
+	rounds_ = std::max<int64_t>(1, ntokens / args_->syncRate);
+	if (args_->verbose > 0) {
+		std::cerr << "Worker " << args_->rank << "/" << args_->nodes << " connected, "
+			<< rounds_ << " sync rounds" << std::endl;
+	}
+}
+
+/**
+* @Function: rank 0 accepts one connection from every other worker.
+*/
+void Distributed::listenPeers(int32_t port) {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) {
+		throw std::runtime_error("Cannot create socket for distributed training.");
+	}
+	int on = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	sockaddr_in addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, args_->nodes) < 0) {
+		close(fd);
+		throw std::runtime_error("Cannot listen on port " + std::to_string(port) + " for distributed training.");
+	}
+	peers_.assign(args_->nodes, -1);
+	for (int32_t i = 1; i < args_->nodes; i++) {
+		int peer = accept(fd, NULL, NULL);
+		if (peer < 0) {
+			close(fd);
+			throw std::runtime_error("Cannot accept worker connection.");
+		}
+		setsockopt(peer, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+		int32_t rank = -1;
+		recvAll(peer, &rank, sizeof(rank));
+		if (rank <= 0 || rank >= args_->nodes || peers_[rank] >= 0) {
+			close(peer);
+			close(fd);
+			throw std::runtime_error("Invalid worker rank " + std::to_string(rank));
+		}
+		peers_[rank] = peer;
+	}
+	close(fd);
+}
+
+/**
+* @Function: worker connects to rank 0, retrying until it is up.
+*/
+void Distributed::connectMaster(const std::string& host, int32_t port) {
+	addrinfo hints;
+	std::memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo* res = NULL;
+	if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res) != 0) {
+		throw std::invalid_argument("Cannot resolve master " + args_->master);
+	}
+	int fd = -1;
+	for (int32_t retry = 0; retry < 600 && fd < 0; retry++) {
+		fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+		if (connect(fd, res->ai_addr, res->ai_addrlen) < 0) {
+			close(fd);
+			fd = -1;
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
+	}
+	freeaddrinfo(res);
+	if (fd < 0) {
+		throw std::runtime_error("Cannot connect to master " + args_->master);
+	}
+	int on = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	int32_t rank = args_->rank;
+	sendAll(fd, &rank, sizeof(rank));
+	peers_.assign(1, fd);
+}
+
+/**
+* @Function: every worker must have built the same dictionary.
+*/
+void Distributed::handshake() {
+	int64_t shape[4] = { mats_[0]->rows(), mats_[0]->cols(), mats_[1]->rows(), mats_[1]->cols() };
+	if (args_->rank != 0) {
+		sendAll(peers_[0], shape, sizeof(shape));
+		return;
+	}
+	for (int32_t i = 1; i < args_->nodes; i++) {
+		int64_t peer[4];
+		recvAll(peers_[i], peer, sizeof(peer));
+		if (std::memcmp(shape, peer, sizeof(shape)) != 0) {
+			throw std::runtime_error("Worker " + std::to_string(i) + " has a different model shape, "
+				"all workers must train with the same -input and dictionary arguments.");
+		}
+	}
+}
+
+void Distributed::sendAll(int fd, const void* buf, size_t n) {
+	const char* p = (const char*)buf;
+	while (n > 0) {
+		ssize_t k = send(fd, p, n, 0);
+		if (k <= 0) {
+			throw std::runtime_error("Distributed training lost connection while sending.");
+		}
+		p += k;
+		n -= k;
+	}
+	bytesSent_ += (p - (const char*)buf);
+}
+
+void Distributed::recvAll(int fd, void* buf, size_t n) {
+	char* p = (char*)buf;
+	while (n > 0) {
+		ssize_t k = recv(fd, p, n, 0);
+		if (k <= 0) {
+			throw std::runtime_error("Distributed training lost connection while receiving.");
+		}
+		p += k;
+		n -= k;
+	}
+}
+
+void Distributed::sendRows(int fd, const SparseRows& rows) {
+	int64_t n = rows.ids.size();
+	sendAll(fd, &n, sizeof(n));
+	sendAll(fd, rows.ids.data(), n * sizeof(int32_t));
+	sendAll(fd, rows.values.data(), rows.values.size() * sizeof(real));
+	rowsSent_ += n;
+}
+
+void Distributed::recvRows(int fd, SparseRows& rows, int64_t dim) {
+	int64_t n = 0;
+	recvAll(fd, &n, sizeof(n));
+	rows.ids.resize(n);
+	rows.values.resize(n * dim);
+	recvAll(fd, rows.ids.data(), n * sizeof(int32_t));
+	recvAll(fd, rows.values.data(), rows.values.size() * sizeof(real));
+}
+
+/**
+* @Function: collect (current - snapshot) of the rows touched since last round.
+*/
+void Distributed::capture(int32_t m, SparseRows& delta) {
+	Matrix& mat = *mats_[m];
+	const int64_t dim = mat.cols();
+	const std::vector<real>& snap = snapshots_[m];
+	delta.ids.clear();
+	delta.values.clear();
+	for (int64_t i = 0; i < mat.rows(); i++) {
+		if (!mat.touched(i))
+			continue;
+		mat.clearTouched(i);
+		delta.ids.push_back(i);
+		for (int64_t j = 0; j < dim; j++) {
+			delta.values.push_back(mat.at(i, j) - snap[i * dim + j]);
+		}
+	}
+}
+
+/**
+* @Function: average the deltas of all workers, rows missing in a delta count as zero.
+*/
+void Distributed::reduce(const std::vector<SparseRows>& deltas, int32_t m, SparseRows& merged) const {
+	const int64_t dim = mats_[m]->cols();
+	std::unordered_map<int32_t, int64_t> slot;
+	merged.ids.clear();
+	merged.values.clear();
+	for (size_t d = 0; d < deltas.size(); d++) {
+		for (size_t k = 0; k < deltas[d].ids.size(); k++) {
+			int32_t id = deltas[d].ids[k];
+			auto it = slot.find(id);
+			int64_t s;
+			if (it == slot.end()) {
+				s = merged.ids.size();
+				slot[id] = s;
+				merged.ids.push_back(id);
+				merged.values.resize(merged.values.size() + dim, 0.0);
+			} else {
+				s = it->second;
+			}
+			for (int64_t j = 0; j < dim; j++) {
+				merged.values[s * dim + j] += deltas[d].values[k * dim + j];
+			}
+		}
+	}
+	real scale = 1.0 / args_->nodes;
+	for (size_t i = 0; i < merged.values.size(); i++) {
+		merged.values[i] *= scale;
+	}
+}
+
+/**
+* @Function: replace the local delta by the averaged one, advance the snapshot.
+*/
+void Distributed::apply(int32_t m, const SparseRows& merged, const SparseRows& local) {
+	Matrix& mat = *mats_[m];
+	const int64_t dim = mat.cols();
+	std::vector<real>& snap = snapshots_[m];
+	// local ids are a sorted subset of merged ids
+	size_t l = 0;
+	std::vector<int32_t> order(merged.ids.size());
+	for (size_t k = 0; k < order.size(); k++) order[k] = k;
+	std::sort(order.begin(), order.end(), [&](int32_t a, int32_t b) { return merged.ids[a] < merged.ids[b]; });
+	for (size_t o = 0; o < order.size(); o++) {
+		size_t k = order[o];
+		int64_t i = merged.ids[k];
+		const real* avg = merged.values.data() + k * dim;
+		const real* own = NULL;
+		if (l < local.ids.size() && local.ids[l] == i) {
+			own = local.values.data() + l * dim;
+			l++;
+		}
+		for (int64_t j = 0; j < dim; j++) {
+			mat.at(i, j) += avg[j] - (own ? own[j] : 0.0);
+			snap[i * dim + j] += avg[j];
+		}
+	}
+}
+
+/**
+* @Function: one averaging round, workers send deltas to rank 0 and get the average back.
+*/
+void Distributed::sync() {
+	for (int32_t m = 0; m < mats_.size(); m++) {
+		SparseRows local;
+		SparseRows merged;
+		capture(m, local);
+		if (args_->rank == 0) {
+			std::vector<SparseRows> deltas(args_->nodes);
+			deltas[0] = local;
+			for (int32_t i = 1; i < args_->nodes; i++) {
+				recvRows(peers_[i], deltas[i], mats_[m]->cols());
+			}
+			reduce(deltas, m, merged);
+			for (int32_t i = 1; i < args_->nodes; i++) {
+				sendRows(peers_[i], merged);
+			}
+		} else {
+			sendRows(peers_[0], local);
+			recvRows(peers_[0], merged, mats_[m]->cols());
+		}
+		apply(m, merged, local);
+	}
+	round_++;
+}
+
+/**
+* @Function: run the rounds that are due at this training progress.
+*/
+void Distributed::step(real progress) {
+	int64_t due = std::min<int64_t>(rounds_ - 1, int64_t(progress * rounds_));
+	while (round_ < due) {
+		sync();
+	}
+}
+
+/**
+* @Function: run the remaining rounds, afterwards all workers hold the same model.
+*/
+void Distributed::finish() {
+	while (round_ < rounds_) {
+		sync();
+	}
+}
+
+void Distributed::printInfo(std::ostream& log_stream) const {
+	log_stream << "Worker " << args_->rank << ": " << round_ << " sync rounds, "
+		<< rowsSent_ << " rows sent, " << bytesSent_ / (1024 * 1024) << " MB sent" << std::endl;
+}
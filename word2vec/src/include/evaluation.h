@@ -0,0 +1,250 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: evaluation.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: word similarity evaluation, Spearman correlation between the cosine
+*            of the word vectors and the human scores of "word1 word2 score" files.
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+
+#include "args.h"
+#include "dictionary.h"
+#include "matrix.h"
+#include "real.h"
+
+class WordSimilarity {
+  protected:
+	struct Word {
+		// rows of the output matrix if true, else the input rows to average
+		bool output;
+		std::vector<int32_t> rows;
+	};
+	struct Pair {
+		int32_t first;
+		int32_t second;
+		real score;
+	};
+	struct Dataset {
+		std::string name;
+		std::vector<Pair> pairs;
+		int64_t total;
+	};
+
+	std::shared_ptr<Args> args_;
+	std::shared_ptr<Dictionary> dict_;
+	std::vector<Word> words_;
+	std::vector<Dataset> datasets_;
+
+	int32_t addWord(const std::string&);
+	void readDataset(const std::string&);
+	void wordVector(const Matrix&, const Matrix&, const Word&, Vector&) const;
+
+  public:
+	WordSimilarity(std::shared_ptr<Args>, std::shared_ptr<Dictionary>);
+
+	size_t size() const;
+	real evaluate(const Matrix&, const Matrix&, std::vector<real>&) const;
+	void printInfo(const std::vector<real>&, std::ostream&) const;
+
+	static void rank(const std::vector<real>&, std::vector<real>&);
+	static real spearman(const std::vector<real>&, const std::vector<real>&);
+};
+
+/**
+* @Function: read the comma separated files of -evalSim.
+*/
+WordSimilarity::WordSimilarity(std::shared_ptr<Args> args, std::shared_ptr<Dictionary> dict)
+	: args_(args), dict_(dict) {
+	std::stringstream ss(args_->evalSim);
+	std::string path;
+	while (std::getline(ss, path, ',')) {
+		if (path != "") {
+			readDataset(path);
+		}
+	}
+}
+
+/**
+* @Function: the rows of a word are resolved once, -1 if the word has none.
+*            the substoke word vectors (.vec) are the output rows, a word out
+*            of the vocabulary has no output row and is left out rather than
+*            compared through the input ngram rows.
+*/
+int32_t WordSimilarity::addWord(const std::string& word) {
+	Word w;
+	w.output = false;
+	if (args_->model == model_name::substoke) {
+		int32_t tid = dict_->getTargetId(word);
+		if (tid < 0) {
+			return -1;
+		}
+		w.output = true;
+		w.rows.push_back(tid);
+	} else {
+		dict_->getSubwords(word, w.rows);
+	}
+	if (w.rows.empty()) {
+		return -1;
+	}
+	words_.push_back(w);
+	return words_.size() - 1;
+}
+
+/**
+* @Function: pairs with a word without rows are counted but not evaluated.
+*/
+void WordSimilarity::readDataset(const std::string& path) {
+	std::ifstream ifs(path);
+	if (!ifs.is_open()) {
+		throw std::invalid_argument(path + " cannot be opened for evaluation!");
+	}
+	Dataset dataset;
+	size_t slash = path.find_last_of('/');
+	dataset.name = slash == std::string::npos ? path : path.substr(slash + 1);
+	dataset.total = 0;
+	std::string line, first, second, score;
+	while (std::getline(ifs, line)) {
+		if (line.empty() || line[0] == '#') {
+			continue;
+		}
+		std::stringstream fields(line);
+		if (!(fields >> first >> second >> score)) {
+			continue;
+		}
+		Pair pair;
+		try {
+			pair.score = std::stod(score);
+		} catch (const std::exception&) {
+			// header line
+			continue;
+		}
+		dataset.total++;
+		pair.first = addWord(first);
+		pair.second = addWord(second);
+		if (pair.first >= 0 && pair.second >= 0) {
+			dataset.pairs.push_back(pair);
+		}
+	}
+	ifs.close();
+	datasets_.push_back(dataset);
+}
+
+size_t WordSimilarity::size() const {
+	return datasets_.size();
+}
+
+void WordSimilarity::wordVector(const Matrix& input, const Matrix& output, const Word& word, Vector& vec) const {
+	const Matrix& mat = word.output ? output : input;
+	vec.zero();
+	for (size_t i = 0; i < word.rows.size(); i++) {
+		vec.addRow(mat, word.rows[i]);
+	}
+	vec.mul(1.0 / word.rows.size());
+}
+
+/**
+* @Function: Spearman correlation of every dataset into scores, the mean is returned.
+*/
+real WordSimilarity::evaluate(const Matrix& input, const Matrix& output, std::vector<real>& scores) const {
+	Vector a(args_->dim);
+	Vector b(args_->dim);
+	std::vector<real> predicted, gold;
+	scores.clear();
+	real mean = 0.0;
+	for (size_t d = 0; d < datasets_.size(); d++) {
+		const std::vector<Pair>& pairs = datasets_[d].pairs;
+		predicted.clear();
+		gold.clear();
+		for (size_t i = 0; i < pairs.size(); i++) {
+			wordVector(input, output, words_[pairs[i].first], a);
+			wordVector(input, output, words_[pairs[i].second], b);
+			real norm = a.norm() * b.norm();
+			real dot = 0.0;
+			for (int64_t j = 0; j < a.size(); j++) {
+				dot += a[j] * b[j];
+			}
+			predicted.push_back(norm > 0 ? dot / norm : 0.0);
+			gold.push_back(pairs[i].score);
+		}
+		scores.push_back(spearman(predicted, gold));
+		mean += scores.back();
+	}
+	return datasets_.empty() ? 0.0 : mean / datasets_.size();
+}
+
+/**
+* @Function: one "name: spearman (pairs/total)" per dataset.
+*/
+void WordSimilarity::printInfo(const std::vector<real>& scores, std::ostream& log_stream) const {
+	for (size_t d = 0; d < datasets_.size() && d < scores.size(); d++) {
+		log_stream << " " << datasets_[d].name << ": " << std::fixed << std::setprecision(4) << scores[d]
+			<< " (" << datasets_[d].pairs.size() << "/" << datasets_[d].total << ")";
+	}
+}
+
+/**
+* @Function: ranks starting at 1, tied values share their average rank.
+*/
+void WordSimilarity::rank(const std::vector<real>& values, std::vector<real>& ranks) {
+	const size_t n = values.size();
+	std::vector<size_t> order(n);
+	for (size_t i = 0; i < n; i++) {
+		order[i] = i;
+	}
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return values[a] < values[b]; });
+	ranks.resize(n);
+	for (size_t i = 0; i < n;) {
+		size_t j = i;
+		while (j + 1 < n && values[order[j + 1]] == values[order[i]]) {
+			j++;
+		}
+		real r = (i + j) / 2.0 + 1.0;
+		for (size_t k = i; k <= j; k++) {
+			ranks[order[k]] = r;
+		}
+		i = j + 1;
+	}
+}
+
+/**
+* @Function: Pearson correlation of the ranks, 0 for less than two pairs.
+*/
+real WordSimilarity::spearman(const std::vector<real>& x, const std::vector<real>& y) {
+	const size_t n = x.size();
+	if (n < 2) {
+		return 0.0;
+	}
+	std::vector<real> rx, ry;
+	rank(x, rx);
+	rank(y, ry);
+	double mx = 0, my = 0;
+	for (size_t i = 0; i < n; i++) {
+		mx += rx[i];
+		my += ry[i];
+	}
+	mx /= n;
+	my /= n;
+	double sxy = 0, sxx = 0, syy = 0;
+	for (size_t i = 0; i < n; i++) {
+		sxy += (rx[i] - mx) * (ry[i] - my);
+		sxx += (rx[i] - mx) * (rx[i] - mx);
+		syy += (ry[i] - my) * (ry[i] - my);
+	}
+	if (sxx == 0 || syy == 0) {
+		return 0.0;
+	}
+	return sxy / std::sqrt(sxx * syy);
+}
@@ -18,6 +18,9 @@
 #include<atomic>
 #include<iomanip>
 #include <thread>
+#include <mutex>
+#include <sstream>
+#include <functional>
 
 #include "args.h"
 #include "dictionary.h"
@@ -25,6 +28,14 @@
 #include "model.h"
 #include "real.h"
 #include "utils.h"
+#include "distributed.h"
+#include "numa.h"
+#include "lrucache.h"
+#include "corpus.h"
+#include "stream.h"
+#include "trace.h"
+#include "evaluation.h"
+#include "analogy.h"
 
 
 class FastText {
@@ -36,17 +47,69 @@ class FastText {
 	std::shared_ptr<Matrix> output_;
 
 	std::shared_ptr<Model> model_;
+	// delayed input gradients of all threads, -delaySentences
+	std::mutex delayMutex_;
+	DelayStats delayStats_;
+	// targets tree of -loss hs
+	std::shared_ptr<HuffmanTree> tree_;
+	std::shared_ptr<Distributed> dist_;
+	std::shared_ptr<NumaReplicas> numa_;
+	// -input -, the lines of stdin for the training threads
+	std::shared_ptr<LineStream> stream_;
+	// a job spec, the word ids of the corpus shared with the other models
+	std::shared_ptr<TokenQueue> tokens_;
 
 	std::atomic<int64_t> tokenCount_;
 	std::atomic<real> loss_;
 
 	clock_t start_;
-
+	std::chrono::steady_clock::time_point wallStart_;
+
+	// word similarity evaluation on a background thread, -evalSim
+	std::shared_ptr<WordSimilarity> eval_;
+	std::thread evalThread_;
+	std::atomic<bool> evalBusy_;
+	real evalProgress_;
+	real evalPending_;
+	std::vector<real> evalScores_;
+	int32_t evalCount_;
+	real evalScore_;
+	// -evalBest, the evaluated copy and the best one so far
+	std::shared_ptr<Matrix> stageInput_;
+	std::shared_ptr<Matrix> stageOutput_;
+	std::shared_ptr<Matrix> bestInput_;
+	std::shared_ptr<Matrix> bestOutput_;
+	real bestScore_;
+	real bestProgress_;
+
+	void startEvaluation(real);
+	void finishEvaluation();
+	void restoreBest();
+
+	// trainThread instantiated for one model and dim, chosen once in train()
+	typedef void (FastText::*Trainer)(int32_t);
+	Trainer trainer_;
+
+	void initMatrices();
+	void startTraining();
 	void startThreads();
+	bool fed() const;
+	int64_t trainTokens() const;
+	Trainer trainer() const;
+	template <model_name MODEL> static Trainer trainerFor(int32_t);
+	template <int32_t DIM> void window(Model&, real, const std::vector<std::vector<int32_t> >&, const std::vector<int32_t>&);
+	template <int32_t DIM> void bagOfWords(Model&, real, const std::vector<std::vector<int32_t> >&, const std::vector<int32_t>&);
+	template <model_name MODEL, int32_t DIM> void trainThread(int32_t);
 
   public:
 	FastText();
 	void saveVectors();
+	void saveModel();
+	void loadModel(const Args, const std::string&);
+	void getWordVector(Vector&, const std::string&, std::vector<int32_t>&) const;
+	void printWordVectors(std::istream&, std::ostream&);
+	std::shared_ptr<Matrix> getWordVectors(std::vector<std::string>&) const;
+	void growMatrices(int32_t);
 	void printInfo(real, real, std::ostream&);
 
 	void skipgram(Model&, real, const std::vector<std::vector<int32_t> >&, const std::vector<int32_t>&);
@@ -55,52 +118,267 @@ class FastText {
 	void substoke(Model&, real, const std::vector<std::vector<int32_t> >&, const std::vector<int32_t>&);
 	void trainThread(int32_t);
 	void train(const Args);
+	void train(const Args, const Dictionary&, std::shared_ptr<TokenQueue>);
 };
 
-FastText::FastText() {}
+static const int32_t MODEL_MAGIC_INT32 = 0x63773276;
+static const int32_t MODEL_VERSION = 3;
+// bytes of -input - handed to a training thread at a time
+static const size_t STREAM_BATCH = 1 << 20;
+
+FastText::FastText() : evalBusy_(false), evalCount_(0), trainer_(NULL) {}
 
 void FastText::train(const Args args) {
 	args_ = std::make_shared<Args>(args);
+	Trace::setCapacity(args_->traceEvents);
 	dict_ = std::make_shared<Dictionary>(args_);
-	if (args_->input == "-") {
-		//manage expectations
-		throw std::invalid_argument("Cannot use stdin for training");
+	// stdin is read once while training, the dictionary has to exist already
+	const bool streaming = args_->input == "-";
+	if (streaming && args_->nodes > 1) {
+		throw std::invalid_argument("-input - cannot be sharded across -nodes, give every worker its own file.");
 	}
 	//std::ifstream ifs(args_->input);
-	std::ifstream ifs(args_->input);
-	if (!ifs.is_open()) {
+	Corpus ifs(args_->input);
+	if (!streaming && !ifs.is_open()) {
 		throw std::invalid_argument(args_->input + "cannot be opened for training!");
 	}
-	std::cout << "Training From " << args_->input << std::endl;
+	std::cout << "Training From " << (streaming ? "stdin" : args_->input) << std::endl;
 
-	if ((args_->model == model_name::skipgram) || (args_->model == model_name::cbow) || (args_->model == model_name::subword)) {
-		// read file to dict
-		dict_->readFromFile(ifs);
+	if (args_->incremental != "") {
+		loadModel(args, args_->incremental);
+		if (args_->model != args.model || args_->dim != args.dim
+			|| args_->minn != args.minn || args_->maxn != args.maxn) {
+			throw std::invalid_argument(args_->incremental + " was trained with a different model, -dim, -minn or -maxn.");
+		}
+		int32_t nwords = dict_->nwords();
+		if (args_->infeature != "") {
+			dict_->readFeature(args_->infeature);
+		}
+		if (!streaming) {
+			dict_->grow(ifs);
+		}
 		ifs.close();
-	} else if (args_->model == model_name::substoke) {
-		if (args_->infeature == "") {
+		growMatrices(nwords);
+	} else {
+		if (args_->model == model_name::substoke && args_->infeature == "") {
 			throw std::invalid_argument("substoke must be have infeature file [-infeature]");
 		}
-		std::ifstream infeature(args_->infeature);
-		if (!infeature.is_open()) {
-			throw std::invalid_argument(args_->infeature + "cannot be opened for training!");
+		if (args_->vocab != "" && dict_->loadCache(args_->vocab)) {
+			ifs.close();
+		} else {
+			if (streaming && args_->vocabCounts == "") {
+				throw std::invalid_argument("-input - needs a prebuilt dictionary, from -vocab, -vocabCounts or -incremental.");
+			}
+			if ((args_->model == model_name::skipgram) || (args_->model == model_name::cbow) || (args_->model == model_name::subword)) {
+				// read file to dict
+				dict_->readFromFile(ifs);
+				ifs.close();
+			} else if (args_->model == model_name::substoke) {
+				dict_->readFromFile(ifs, args_->infeature);
+				ifs.close();
+			}
+			if (args_->vocab != "" && args_->rank == 0) {
+				dict_->saveCache(args_->vocab);
+			}
 		}
-		dict_->readFromFile(ifs, infeature);
-		ifs.close();
-		infeature.close();
+
+		initMatrices();
+	}
+	if (streaming) {
+		std::ios::sync_with_stdio(false);
+		stream_ = std::make_shared<LineStream>(std::cin, STREAM_BATCH, 4 * args_->thread);
 	}
+	startTraining();
+}
+
+/**
+* @Function: train one model of a job spec on the words counted once for all of
+*            them, the lines come as word ids from tokens.
+*/
+void FastText::train(const Args args, const Dictionary& counted, std::shared_ptr<TokenQueue> tokens) {
+	args_ = std::make_shared<Args>(args);
+	dict_ = std::make_shared<Dictionary>(args_);
+	dict_->share(counted);
+	initMatrices();
+	tokens_ = tokens;
+	startTraining();
+}
 
-	input_ = std::make_shared<Matrix>(dict_->nwords() + dict_->nfeatures(), args_->dim);
-	//input_ = std::make_shared<Matrix>(dict_->nwords() + args_->bucket, args_->dim);
+/**
+* @Function: input rows random, output rows zero.
+*/
+void FastText::initMatrices() {
+	input_ = std::make_shared<Matrix>(dict_->ninput(), args_->dim);
 	input_->uniform(1.0 / args_->dim);
+	if (args_->verbose > 0) {
+		std::cerr << "Input matrix: " << input_->rows() << " x " << args_->dim << ", "
+			<< input_->rows() * args_->dim * sizeof(real) / (1024 * 1024) << "MB" << std::endl;
+	}
 
 	output_ = std::make_shared<Matrix>(dict_->nwords(), args_->dim);
 	output_->zero();
+}
+
+/**
+* @Function: the training threads on the dictionary and matrices, model_ is left
+*            for the vectors of out of vocabulary words.
+*/
+void FastText::startTraining() {
+	if (args_->nodes > 1) {
+		dist_ = std::make_shared<Distributed>(args_, input_, output_);
+		dist_->start(trainTokens());
+	}
+	if (args_->numa > 0) {
+		numa_ = std::make_shared<NumaReplicas>(args_, input_, output_);
+		numa_->start(trainTokens());
+		input_ = numa_->input(0);
+		output_ = numa_->output(0);
+	}
+	if (args_->evalSim != "" && args_->rank == 0) {
+		eval_ = std::make_shared<WordSimilarity>(args_, dict_);
+	}
+	if (args_->loss == loss_name::hs) {
+		tree_ = std::make_shared<HuffmanTree>(dict_->getCounts());
+		if (args_->verbose > 0) {
+			std::cerr << "Huffman tree: depth " << tree_->depth() << ", " << tree_->size() / (1024 * 1024) << "MB of paths" << std::endl;
+		}
+	}
+	if (!fed()) {
+		TRACE_SCOPE("indexCorpus");
+		Corpus::index(args_->input);
+	}
+	trainer_ = trainer();
 	startThreads();
+	stream_.reset();
+	tokens_.reset();
 	model_ = std::make_shared<Model>(input_, output_, args_, 0);
 	model_->setTargetCounts(dict_->getCounts());
+	if (tree_) {
+		model_->setTree(tree_);
+	}
+}
+
+/**
+* @Function: load dictionary and matrices written by saveModel(), the model,
+*            dim, minn and maxn of args are replaced by the saved ones.
+*/
+void FastText::loadModel(const Args args, const std::string& filename) {
+	args_ = std::make_shared<Args>(args);
+	std::ifstream ifs(filename, std::ifstream::binary);
+	if (!ifs.is_open()) {
+		throw std::invalid_argument(filename + " cannot be opened for loading!");
+	}
+	int32_t magic = 0;
+	int32_t version = 0;
+	ifs.read((char*)&magic, sizeof(int32_t));
+	ifs.read((char*)&version, sizeof(int32_t));
+	if (magic != MODEL_MAGIC_INT32 || version != MODEL_VERSION) {
+		throw std::invalid_argument(filename + " has wrong file format!");
+	}
+	Args saved;
+	saved.load(ifs);
+	args_->model = saved.model;
+	args_->dim = saved.dim;
+	args_->minn = saved.minn;
+	args_->maxn = saved.maxn;
+	args_->hash = saved.hash;
+	args_->bucket = saved.bucket;
+	dict_ = std::make_shared<Dictionary>(args_);
+	dict_->load(ifs);
+	input_ = std::make_shared<Matrix>();
+	output_ = std::make_shared<Matrix>();
+	input_->load(ifs);
+	output_->load(ifs);
+	if (!ifs || input_->cols() != args_->dim || output_->rows() != dict_->nwords()) {
+		throw std::invalid_argument(filename + " is truncated or corrupted.");
+	}
+	ifs.close();
+}
+
+/**
+* @Function: save args, dictionary and matrices, the model can be trained again by -incremental.
+*/
+void FastText::saveModel() {
+	TRACE_SCOPE("saveModel");
+	if (args_->rank != 0) {
+		return;
+	}
+	std::ofstream ofs(args_->output + ".bin", std::ofstream::binary);
+	if (!ofs.is_open()) {
+		throw std::invalid_argument(args_->output + ".bin" + " cannot be opened for saving model.");
+	}
+	std::cout << "Saving model to " << args_->output + ".bin" << std::endl;
+	ofs.write((char*)&MODEL_MAGIC_INT32, sizeof(int32_t));
+	ofs.write((char*)&MODEL_VERSION, sizeof(int32_t));
+	args_->save(ofs);
+	dict_->save(ofs);
+	input_->save(ofs);
+	output_->save(ofs);
+	ofs.close();
+}
+
+/**
+* @Function: resize the loaded matrices to the grown dictionary. old rows are kept,
+*            new rows start random, new substoke words start from their stroke n-grams.
+*/
+void FastText::growMatrices(int32_t nwords) {
+	const int64_t nngrams = input_->rows() - nwords;
+	std::shared_ptr<Matrix> input = std::make_shared<Matrix>(dict_->ninput(), args_->dim);
+	input->uniform(1.0 / args_->dim);
+	std::shared_ptr<Matrix> output = std::make_shared<Matrix>(dict_->nwords(), args_->dim);
+	output->zero();
+
+	const int64_t dim = args_->dim;
+	// subword rows are [words | features], the other models index rows by id directly
+	if (args_->model == model_name::subword) {
+		std::copy(input_->data(), input_->data() + nwords * dim, input->data());
+		std::copy(input_->data() + nwords * dim, input_->data() + (nwords + nngrams) * dim,
+			input->data() + dict_->nwords() * dim);
+	} else {
+		// substoke models saved before the input matrix was compact have more rows
+		std::copy(input_->data(), input_->data() + std::min(input_->rows(), input->rows()) * dim, input->data());
+	}
+	std::copy(output_->data(), output_->data() + output_->rows() * dim, output->data());
+
+	Vector vec(args_->dim);
+	for (int32_t i = nwords; i < dict_->nwords(); i++) {
+		const int32_t* ngrams = dict_->subwords(i);
+		const int32_t n = dict_->nsubwords(i);
+		if (n == 0 || args_->model == model_name::skipgram || args_->model == model_name::cbow)
+			continue;
+		vec.zero();
+		for (int32_t j = 0; j < n; j++) {
+			vec.addRow(*input, ngrams[j]);
+		}
+		vec.mul(1.0 / n);
+		// substoke exports the output rows, subword the input rows
+		Matrix& mat = args_->model == model_name::substoke ? *output : *input;
+		for (int64_t j = 0; j < dim; j++) {
+			mat.at(i, j) = vec[j];
+		}
+	}
+	input_ = input;
+	output_ = output;
+}
+
+/**
+* @Function: whether the lines come from stdin or a job spec, they are trained
+*            until they end instead of for trainTokens().
+*/
+bool FastText::fed() const {
+	return stream_ || tokens_;
 }
 
+/**
+* @Function: tokens this process trains on, each worker takes its share of the epochs.
+*            a stream is trained to its end, the count only sets the lr schedule.
+*/
+int64_t FastText::trainTokens() const {
+	if (args_->input == "-" && args_->streamTokens > 0) {
+		return args_->streamTokens;
+	}
+	return args_->epoch * dict_->ncorpus() / args_->nodes;
+}
 
 void FastText::printInfo(real progress, real loss, std::ostream& log_stream) {
 	// clock_t might also only be 32bits wide on some systems
@@ -123,102 +401,225 @@ void FastText::printInfo(real progress, real loss, std::ostream& log_stream) {
 	log_stream << " loss: " << std::setw(9) << std::setprecision(6) << loss;
 	log_stream << " ETA: " << std::setw(3) << etah;
 	log_stream << "h" << std::setw(2) << etam << "m";
+	if (evalCount_ > 0) {
+		log_stream << " spearman: " << std::setprecision(4) << evalScore_;
+	}
 	log_stream << std::flush;
 }
 
 void FastText::skipgram(Model& model, real lr, const std::vector<std::vector<int32_t> >& source,
 	const std::vector<int32_t>& target) {
-	std::uniform_int_distribution<> uniform(1, args_->ws);
-	for (int32_t w = 0; w < target.size(); w++) {
-		int32_t boundary = uniform(model.rng);
+	window<0>(model, lr, source, target);
+}
+
+void FastText::cbow(Model& model, real lr, const std::vector<std::vector<int32_t> >& source,
+	const std::vector<int32_t>& target) {
+	bagOfWords<0>(model, lr, source, target);
+}
+
+void FastText::subword(Model& model, real lr, const std::vector<std::vector<int32_t> >& source, const std::vector<int32_t>& target) {
+	window<0>(model, lr, source, target);
+}
+
+void FastText::substoke(Model& model, real lr, const std::vector<std::vector<int32_t> >& source, const std::vector<int32_t>& target) {
+	window<0>(model, lr, source, target);
+}
+
+/**
+* @Function: skipgram, subword and substoke, the source of the center word
+*            predicts every word in the window.
+*/
+template <int32_t DIM>
+void FastText::window(Model& model, real lr, const std::vector<std::vector<int32_t> >& source,
+	const std::vector<int32_t>& target) {
+	const int32_t length = target.size();
+	const int32_t* boundaries = model.rng.windows(args_->ws, length);
+	if (args_->reuseHidden) {
+		// the window targets of a position as one contiguous range minus the center
+		std::vector<int32_t> contexts(2 * args_->ws);
+		for (int32_t w = 0; w < length; w++) {
+			const int32_t first = std::max(0, w - boundaries[w]);
+			const int32_t last = std::min(length - 1, w + boundaries[w]);
+			int32_t n = 0;
+			for (int32_t c = first; c <= last; c++) {
+				if (c != w) {
+					contexts[n++] = target[c];
+				}
+			}
+			model.updateWindow<DIM>(source[w], contexts.data(), n, lr);
+		}
+		return;
+	}
+	for (int32_t w = 0; w < length; w++) {
+		int32_t boundary = boundaries[w];
 		const std::vector<int32_t>& ngrams = source[w];
-		assert(ngrams.size() == 1);
 		for (int32_t c = -boundary; c <= boundary; c++) {
-			if (c != 0 && w + c >= 0 && w + c < target.size()) {
-				model.update(ngrams, target[w + c], lr);
+			if (c != 0 && w + c >= 0 && w + c < length) {
+				model.update<DIM>(ngrams, target[w + c], lr);
 			}
 		}
 	}
 }
 
-void FastText::cbow(Model& model, real lr, const std::vector<std::vector<int32_t> >& source,
+/**
+* @Function: cbow, the sources of the window predict the center word.
+*/
+template <int32_t DIM>
+void FastText::bagOfWords(Model& model, real lr, const std::vector<std::vector<int32_t> >& source,
 	const std::vector<int32_t>& target) {
 	std::vector<int32_t> bow;
-	std::uniform_int_distribution<> uniform(1, args_->ws);
-	for (int32_t w = 0; w < target.size(); w++) {
-		int32_t boundary = uniform(model.rng);
+	const int32_t length = target.size();
+	const int32_t* boundaries = model.rng.windows(args_->ws, length);
+	for (int32_t w = 0; w < length; w++) {
+		int32_t boundary = boundaries[w];
 		bow.clear();
 		for (int32_t c = -boundary; c <= boundary; c++) {
-			if (c != 0 && w + c >= 0 && w + c < target.size()) {
+			if (c != 0 && w + c >= 0 && w + c < length) {
 				const std::vector<int32_t>& ngrams = source[w + c];
 				bow.insert(bow.end(), ngrams.begin(), ngrams.cend());
 			}
 		}
-		model.update(bow, target[w], lr);
+		model.update<DIM>(bow, target[w], lr);
 	}
 }
 
-void FastText::subword(Model& model, real lr, const std::vector<std::vector<int32_t> >& source, const std::vector<int32_t>& target) {
-	std::uniform_int_distribution<> uniform(1, args_->ws);
-	for (int32_t w = 0; w < target.size(); w++) {
-		int32_t boundary = uniform(model.rng);
-		const std::vector<int32_t>& ngrams = source[w];
-		for (int32_t c = -boundary; c <= boundary; c++) {
-			if (c != 0 && w + c >= 0 && w + c < target.size()) {
-				model.update(ngrams, target[w + c], lr);
-			}
-		}
+/**
+* @Function: pick the trainThread instantiation for the model and dim once,
+*            dims other than 50, 100, 200 and 300 use the generic loops.
+*/
+template <model_name MODEL>
+FastText::Trainer FastText::trainerFor(int32_t dim) {
+	switch (dim) {
+	case 50:
+		return &FastText::trainThread<MODEL, 50>;
+	case 100:
+		return &FastText::trainThread<MODEL, 100>;
+	case 200:
+		return &FastText::trainThread<MODEL, 200>;
+	case 300:
+		return &FastText::trainThread<MODEL, 300>;
+	default:
+		return &FastText::trainThread<MODEL, 0>;
 	}
 }
 
-void FastText::substoke(Model& model, real lr, const std::vector<std::vector<int32_t> >& source, const std::vector<int32_t>& target) {
-	std::uniform_int_distribution<> uniform(1, args_->ws);
-	for (int32_t w = 0; w < target.size(); w++) {
-		int32_t boundary = uniform(model.rng);
-		const std::vector<int32_t>& ngrams = source[w];
-		for (int32_t c = -boundary; c <= boundary; c++) {
-			if (c != 0 && w + c >= 0 && w + c < target.size()) {
-				model.update(ngrams, target[w + c], lr);
-			}
-		}
+FastText::Trainer FastText::trainer() const {
+	if (args_->model == model_name::cbow) {
+		return trainerFor<model_name::cbow>(args_->dim);
+	} else if (args_->model == model_name::subword) {
+		return trainerFor<model_name::subword>(args_->dim);
+	} else if (args_->model == model_name::substoke) {
+		return trainerFor<model_name::substoke>(args_->dim);
 	}
+	return trainerFor<model_name::skipgram>(args_->dim);
 }
 
 void FastText::trainThread(int32_t threadId) {
-	std::ifstream ifs(args_->input);
-	utils::seek(ifs, threadId * utils::size(ifs) / args_->thread);
+	(this->*trainer_)(threadId);
+}
 
-	Model model(input_, output_, args_, threadId);
+template <model_name MODEL, int32_t DIM>
+void FastText::trainThread(int32_t threadId) {
+	TRACE_SCOPE("trainThread");
+	Corpus ifs(fed() ? std::string() : args_->input);
+	if (!fed()) {
+		// each worker reads its own shard of the file, split again across threads
+		const int64_t shard = utils::size(ifs) / args_->nodes;
+		utils::seek(ifs, args_->rank * shard + threadId * shard / args_->thread);
+	}
+	// a stream is read as batches of lines taken from stream_, a line is
+	// trained MAX_LINE_SIZE words at a time
+	std::string batch;
+	std::istringstream lines;
+	std::vector<int32_t> words;
+	size_t next = 0;
+	// a job spec gives batches of word ids
+	std::shared_ptr<const TokenBatch> tokens;
+	size_t line = 0;
+
+	std::shared_ptr<Matrix> input = input_;
+	std::shared_ptr<Matrix> output = output_;
+	int32_t node = 0;
+	if (numa_) {
+		node = numa_->nodeOf(threadId);
+		numa_->pin(node);
+		input = numa_->input(node);
+		output = numa_->output(node);
+	}
+	Model model(input, output, args_, args_->rank * args_->thread + threadId);
 	model.setTargetCounts(dict_->getCounts());
+	if (tree_) {
+		model.setTree(tree_);
+	}
 
-	const int64_t ntokens = dict_->ntokens();
+	const int64_t ntokens = trainTokens();
 	int64_t localTokenCount = 0;
 	std::vector<std::vector<int32_t> > sourceType;
 	std::vector<std::vector<int32_t> > source;
 	std::vector<int32_t> target;
-	while (tokenCount_ < args_->epoch * ntokens) {
-		real process = real(tokenCount_) / (args_->epoch * ntokens);
+	while (fed() || tokenCount_ < ntokens) {
+		if (stream_ && next >= words.size() && lines.peek() == EOF) {
+			if (!stream_->pop(batch)) {
+				break;
+			}
+			lines.clear();
+			lines.str(batch);
+		}
+		if (tokens_ && (!tokens || line + 1 >= tokens->lines.size())) {
+			if (!tokens_->pop(tokens)) {
+				break;
+			}
+			line = 0;
+		}
+		real process = real(tokenCount_) / ntokens;
 		real lr = args_->lr * (1.0 - process);
-		if (args_->model == model_name::skipgram) {
-			localTokenCount += dict_->getLine(ifs, sourceType, source, target, model.rng);
-			skipgram(model, lr, source, target);
-		} else if (args_->model == model_name::cbow) {
-			localTokenCount += dict_->getLine(ifs, sourceType, source, target, model.rng);
-			cbow(model, lr, source, target);
-		} else if (args_->model == model_name::subword) {
-			localTokenCount += dict_->getLine(ifs, sourceType, source, target, model.rng);
-			subword(model, lr, source, target);
-		} else if (args_->model == model_name::substoke) {
+		if (fed()) {
+			// a stream longer than expected goes on at the lowest lr
+			lr = std::max(lr, real(args_->lr * 1e-4));
+		}
+		if (tokens_) {
+			const int32_t* words = tokens->words.data() + tokens->lines[line];
+			localTokenCount += dict_->getLine(words, tokens->lines[line + 1] - tokens->lines[line], sourceType, source, target, model.rng);
+			line++;
+		} else if (stream_) {
+			if (next >= words.size()) {
+				words.clear();
+				next = 0;
+				dict_->readLine(lines, words);
+			}
+			const int32_t n = std::min<size_t>(Dictionary::MAX_LINE_SIZE, words.size() - next);
+			localTokenCount += dict_->getLine(words.data() + next, n, sourceType, source, target, model.rng);
+			next += n;
+		} else {
 			localTokenCount += dict_->getLine(ifs, sourceType, source, target, model.rng);
-			substoke(model, lr, source, target);
 		}
+		if (MODEL == model_name::cbow) {
+			bagOfWords<DIM>(model, lr, source, target);
+		} else {
+			window<DIM>(model, lr, source, target);
+		}
+		model.endLine();
 		if (localTokenCount > args_->lrUpdateRate) {
 			tokenCount_ += localTokenCount;
+			if (numa_)
+				numa_->addTokens(node, localTokenCount);
 			localTokenCount = 0;
 			if (threadId == 0 && args_->verbose > 1)
 				loss_ = model.getLoss();
 		}
 	}
+	model.flush();
+	if (fed()) {
+		tokenCount_ += localTokenCount;
+	}
+	if (args_->delaySentences > 0) {
+		std::lock_guard<std::mutex> lock(delayMutex_);
+		const DelayStats& stats = model.delayStats();
+		delayStats_.updates += stats.updates;
+		delayStats_.writes += stats.writes;
+		delayStats_.flushes += stats.flushes;
+		delayStats_.capped += stats.capped;
+	}
 	if (threadId == 0)
 		loss_ = model.getLoss();
 	ifs.close();
@@ -226,20 +627,43 @@ void FastText::trainThread(int32_t threadId) {
 
 void FastText::startThreads() {
 	start_ = clock();
+	wallStart_ = std::chrono::steady_clock::now();
 	tokenCount_ = 0;
 	loss_ = -1;
+	delayStats_ = DelayStats();
 	std::vector<std::thread> threads;
 	for (int32_t i = 0; i < args_->thread; i++) {
 		threads.push_back(std::thread([=]() {
 			trainThread(i);
 		}));
 	}
-	const int64_t ntokens = dict_->ntokens();
+	const int64_t ntokens = trainTokens();
+	const int64_t evalRate = args_->evalRate > 0 ? args_->evalRate : std::max<int64_t>(1, ntokens / args_->epoch);
+	int64_t nextEval = evalRate;
 	// Same condition as trainThread
-	while (tokenCount_ < args_->epoch * ntokens) {
+	while (stream_ ? !stream_->done() : tokens_ ? !tokens_->done() : tokenCount_ < ntokens) {
 		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		real progress = std::min(real(1.0), real(tokenCount_) / ntokens);
+		if (dist_) {
+			dist_->step(progress);
+		}
+		if (numa_) {
+			numa_->step(progress);
+		}
+		if (eval_) {
+			if (evalThread_.joinable() && !evalBusy_) {
+				finishEvaluation();
+			}
+			// one evaluation at a time, a late one is not queued again
+			const int64_t count = tokenCount_;
+			if (!evalThread_.joinable() && count >= nextEval && count < ntokens) {
+				startEvaluation(progress);
+				while (nextEval <= count) {
+					nextEval += evalRate;
+				}
+			}
+		}
 		if (loss_ >= 0 && args_->verbose > 1) {
-			real progress = real(tokenCount_) / (args_->epoch * ntokens);
 			std::cerr << "\r";
 			printInfo(progress, loss_, std::cerr);
 		}
@@ -247,19 +671,130 @@ void FastText::startThreads() {
 	for (int32_t i = 0; i < args_->thread; i++) {
 		threads[i].join();
 	}
+	if (dist_) {
+		dist_->finish();
+	}
+	if (numa_) {
+		numa_->finish();
+	}
+	if (eval_) {
+		if (evalThread_.joinable()) {
+			finishEvaluation();
+		}
+		startEvaluation(1.0);
+		finishEvaluation();
+	}
 	if (args_->verbose > 0) {
 		std::cerr << "\r";
-		printInfo(1.0, loss_, std::cerr);
+		// a stream may end before or after the tokens it was expected to have
+		printInfo(fed() ? std::min(real(1.0), real(tokenCount_) / ntokens) : 1.0, loss_, std::cerr);
 		std::cerr << std::endl;
+		if (dist_) {
+			dist_->printInfo(std::cerr);
+		}
+		if (numa_) {
+			numa_->printInfo(std::cerr);
+		} else {
+			double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart_).count();
+			std::cerr << "Shared matrix: " << args_->thread << " threads, "
+				<< int64_t(tokenCount_ / t) << " words/sec" << std::endl;
+		}
+		if (stream_) {
+			double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart_).count();
+			const double mb = stream_->bytes() / (1024.0 * 1024.0);
+			std::cerr << "Stream: " << stream_->lines() << " lines, " << std::fixed << std::setprecision(1)
+				<< mb << "MB (" << mb / t << "MB/sec), "
+				<< tokenCount_ << " of " << ntokens << " expected tokens, reader waited " << stream_->full()
+				<< " times, trainers waited " << stream_->empty() << " times" << std::endl;
+		}
+		if (tokens_) {
+			std::cerr << "Shared corpus: " << tokenCount_ << " of " << ntokens << " expected tokens, reader waited "
+				<< tokens_->full() << " times, trainers waited " << tokens_->empty() << " times" << std::endl;
+		}
+		if (args_->delaySentences > 0) {
+			double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart_).count();
+			const DelayStats& s = delayStats_;
+			std::cerr << "Delayed gradients: " << s.updates << " buffered, " << s.writes << " rows written ("
+				<< std::fixed << std::setprecision(1) << double(s.updates) / std::max<int64_t>(1, s.writes)
+				<< " per write, " << int64_t(s.writes / t) << " writes/sec), "
+				<< s.flushes << " flushes (" << std::setprecision(2) << s.flushes / t << "/sec), "
+				<< s.capped << " rows written at -delayCap" << std::endl;
+		}
+	}
+	if (eval_ && args_->evalBest) {
+		restoreBest();
+	}
+}
+
+/**
+* @Function: evaluate the matrices on a background thread, with -evalBest a copy
+*            is evaluated so it can be kept.
+*/
+void FastText::startEvaluation(real progress) {
+	evalBusy_ = true;
+	evalProgress_ = progress;
+	evalThread_ = std::thread([=]() {
+		if (args_->evalBest) {
+			if (!stageInput_) {
+				stageInput_ = std::make_shared<Matrix>(*input_);
+				stageOutput_ = std::make_shared<Matrix>(*output_);
+			} else {
+				std::copy(input_->data(), input_->data() + input_->rows() * input_->cols(), stageInput_->data());
+				std::copy(output_->data(), output_->data() + output_->rows() * output_->cols(), stageOutput_->data());
+			}
+			evalPending_ = eval_->evaluate(*stageInput_, *stageOutput_, evalScores_);
+		} else {
+			evalPending_ = eval_->evaluate(*input_, *output_, evalScores_);
+		}
+		evalBusy_ = false;
+	});
+}
+
+/**
+* @Function: wait for the running evaluation, log it and keep the best copy.
+*/
+void FastText::finishEvaluation() {
+	evalThread_.join();
+	evalScore_ = evalPending_;
+	evalCount_++;
+	if (args_->evalBest && (bestInput_ == NULL || evalScore_ > bestScore_)) {
+		bestScore_ = evalScore_;
+		bestProgress_ = evalProgress_;
+		std::swap(stageInput_, bestInput_);
+		std::swap(stageOutput_, bestOutput_);
+	}
+	if (args_->verbose > 1) {
+		std::cerr << "\nEvaluation at " << std::fixed << std::setprecision(1) << evalProgress_ * 100 << "%:";
+		eval_->printInfo(evalScores_, std::cerr);
+		std::cerr << " mean: " << std::setprecision(4) << evalScore_ << std::endl;
+	}
+}
+
+/**
+* @Function: -evalBest, put the best evaluated snapshot back before saving.
+*/
+void FastText::restoreBest() {
+	if (bestInput_ == NULL || bestProgress_ >= 1.0) {
+		return;
 	}
+	std::copy(bestInput_->data(), bestInput_->data() + bestInput_->rows() * bestInput_->cols(), input_->data());
+	std::copy(bestOutput_->data(), bestOutput_->data() + bestOutput_->rows() * bestOutput_->cols(), output_->data());
+	std::cerr << "Restored the snapshot at " << std::fixed << std::setprecision(1) << bestProgress_ * 100
+		<< "% with spearman " << std::setprecision(4) << bestScore_ << " over the last " << evalScore_ << std::endl;
 }
 
 void FastText::saveVectors() {
+	TRACE_SCOPE("saveVectors");
+	// after the last sync every worker holds the same model, rank 0 saves it
+	if (args_->rank != 0) {
+		return;
+	}
 	std::cout << "Saving word embedding to " << args_->output << std::endl;
 	std::cout << "Saving word embedding, maybe take a while......" << std::endl;
 	int32_t nwords = dict_->nwords();
 	int32_t ntargets = dict_->ntargets();
 	int32_t nfeatures = dict_->nfeatures();
+	int32_t nngrams = dict_->nngrams();
 
 	Vector vec(args_->dim);
 	Vector vec_zero(args_->dim);
@@ -281,8 +816,8 @@ void FastText::saveVectors() {
 		ofs.close();
 	}
 
-	if ((nwords > 0 && nfeatures > 0 && args_->model == model_name::substoke) 
-		|| (nwords > 0 && nfeatures > 0 && args_->model == model_name::subword)) {
+	if ((nwords > 0 && nngrams > 0 && args_->model == model_name::substoke) 
+		|| (nwords > 0 && nngrams > 0 && args_->model == model_name::subword)) {
 		std::string outfile;
 		if (args_->model == model_name::subword) {
 			outfile = args_->output + ".vec";
@@ -297,22 +832,26 @@ void FastText::saveVectors() {
 		ofs << nwords << " " << args_->dim << std::endl;
 		for (int32_t i = 0; i < nwords; i++) {
 			std::string word = dict_->getWord(i);
-			std::vector<int32_t> ngrams = dict_->wordprops_[i].subwords;
+			const int32_t* ngrams = dict_->subwords(i);
+			const int32_t n = dict_->nsubwords(i);
 			vec.zero();
 			//vec.addRow(*input_, i);
-			for (int32_t i = 0; i < ngrams.size(); i++) {
-				//vec.addRow(*input_, nwords + ngrams[i]);
-				vec.addRow(*input_, ngrams[i]);
+			for (int32_t j = 0; j < n; j++) {
+				//vec.addRow(*input_, nwords + ngrams[j]);
+				vec.addRow(*input_, ngrams[j]);
 			}
-			if (ngrams.size() > 0) {
-				vec.mul(1.0 / ngrams.size());
+			if (n > 0) {
+				vec.mul(1.0 / n);
 			} 
 			ofs << word << " " << vec << std::endl;
 		}
 		ofs.close();
 	}
 
-	if (nfeatures == -1) {
+	if (nfeatures > 0 && args_->saveFeature
+		&& (args_->model == model_name::substoke || args_->model == model_name::subword)) {
+		// subword rows are [words | features], substoke rows are feature ids
+		int32_t offset = args_->model == model_name::subword ? nwords : 0;
 		std::ofstream ofs(args_->output + ".feature");
 		if (!ofs.is_open()) {
 			throw std::invalid_argument(
@@ -322,8 +861,7 @@ void FastText::saveVectors() {
 		for (int32_t i = 0; i < nfeatures; i++) {
 			std::string feature = dict_->getFeature(i);
 			vec.zero();
-			//vec.addRow(*input_, nwords + i);
-			vec.addRow(*input_, i);
+			vec.addRow(*input_, offset + i);
 			ofs << feature << " " << vec << std::endl;
 		}
 
@@ -347,11 +885,105 @@ void FastText::saveVectors() {
 	std::cout << "Save word embedding finished." << std::endl;
 }
 
+/**
+* @Function: average of the rows of a word, out of vocabulary words use their
+*            subword or stroke ngrams, a zero vector if no row is known.
+*/
+void FastText::getWordVector(Vector& vec, const std::string& word, std::vector<int32_t>& ngrams) const {
+	dict_->getSubwords(word, ngrams);
+	vec.zero();
+	for (size_t i = 0; i < ngrams.size(); i++) {
+		vec.addRow(*input_, ngrams[i]);
+	}
+	if (ngrams.size() > 0) {
+		vec.mul(1.0 / ngrams.size());
+	}
+}
 
+/**
+* @Function: the vectors written to the .vec file, words receives the vocabulary.
+*/
+std::shared_ptr<Matrix> FastText::getWordVectors(std::vector<std::string>& words) const {
+	words.clear();
+	if (args_->model == model_name::substoke) {
+		for (int32_t i = 0; i < dict_->ntargets(); i++) {
+			words.push_back(dict_->getTarget(i));
+		}
+		return std::make_shared<Matrix>(*output_);
+	}
+	std::shared_ptr<Matrix> vectors = std::make_shared<Matrix>(dict_->nwords(), args_->dim);
+	Vector vec(args_->dim);
+	std::vector<int32_t> ngrams;
+	for (int32_t i = 0; i < dict_->nwords(); i++) {
+		words.push_back(dict_->getWord(i));
+		getWordVector(vec, words[i], ngrams);
+		std::copy(vec.data(), vec.data() + args_->dim, vectors->data() + int64_t(i) * args_->dim);
+	}
+	return vectors;
+}
 
-
-
-
-
-
-
+/**
+* @Function: print the vector of every word read from in, batches are split by
+*            word hash over the threads so every thread caches its own words.
+*/
+void FastText::printWordVectors(std::istream& in, std::ostream& out) {
+	const int32_t nthreads = args_->thread;
+	const size_t batch = 100000;
+	std::vector<std::shared_ptr<LRUCache> > caches;
+	for (int32_t t = 0; t < nthreads; t++) {
+		caches.push_back(std::make_shared<LRUCache>(args_->cacheSize / nthreads));
+	}
+	std::vector<std::string> words;
+	std::vector<std::string> lines;
+	std::vector<int32_t> owners;
+	std::hash<std::string> hash;
+	std::string word;
+	int64_t nwords = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	while (in) {
+		words.clear();
+		while (words.size() < batch && in >> word) {
+			words.push_back(word);
+		}
+		lines.resize(words.size());
+		owners.resize(words.size());
+		for (size_t i = 0; i < words.size(); i++) {
+			owners[i] = hash(words[i]) % nthreads;
+		}
+		std::vector<std::thread> threads;
+		for (int32_t t = 0; t < nthreads; t++) {
+			threads.push_back(std::thread([&, t]() {
+				Vector vec(args_->dim);
+				std::vector<int32_t> ngrams;
+				std::ostringstream oss;
+				LRUCache& cache = *caches[t];
+				for (size_t i = 0; i < words.size(); i++) {
+					if (owners[i] != t || cache.get(words[i], lines[i]))
+						continue;
+					getWordVector(vec, words[i], ngrams);
+					oss.str("");
+					oss << words[i] << " " << vec;
+					lines[i] = oss.str();
+					cache.put(words[i], lines[i]);
+				}
+			}));
+		}
+		for (int32_t t = 0; t < nthreads; t++) {
+			threads[t].join();
+		}
+		for (size_t i = 0; i < lines.size(); i++) {
+			out << lines[i] << "\n";
+		}
+		out.flush();
+		nwords += words.size();
+	}
+	if (args_->verbose > 0) {
+		double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		int64_t hits = 0;
+		for (int32_t i = 0; i < nthreads; i++) {
+			hits += caches[i]->hits;
+		}
+		std::cerr << "Printed " << nwords << " word vectors, " << int64_t(nwords / std::max(t, 1e-6))
+			<< " words/sec, cache hit rate " << std::setprecision(3) << (nwords > 0 ? double(hits) / nwords : 0.0) << std::endl;
+	}
+}
@@ -0,0 +1,105 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: huffman.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: Huffman tree of the targets for the hierarchical softmax, the path
+*            of every target (inner nodes and the branch taken at each) is kept
+*            in flat arrays shared by all training threads.
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+class HuffmanTree {
+  protected:
+	// path of target i is [offsets_[i], offsets_[i + 1]) of nodes_ and codes_
+	std::vector<int64_t> offsets_;
+	std::vector<int32_t> nodes_;
+	std::vector<uint8_t> codes_;
+	int32_t depth_;
+
+  public:
+	explicit HuffmanTree(const std::vector<int64_t>&);
+
+	inline int32_t length(int32_t target) const {
+		return offsets_[target + 1] - offsets_[target];
+	}
+	inline const int32_t* nodes(int32_t target) const {
+		return nodes_.data() + offsets_[target];
+	}
+	inline const uint8_t* codes(int32_t target) const {
+		return codes_.data() + offsets_[target];
+	}
+	int32_t depth() const;
+	int64_t size() const;
+};
+
+/**
+* @Function: build the tree with two queues, the leaves sorted by count and the
+*            inner nodes in order of creation, inner node k is output row k.
+*/
+HuffmanTree::HuffmanTree(const std::vector<int64_t>& counts) : depth_(0) {
+	const int32_t n = counts.size();
+	std::vector<int32_t> leaves(n);
+	for (int32_t i = 0; i < n; i++) {
+		leaves[i] = i;
+	}
+	std::stable_sort(leaves.begin(), leaves.end(), [&](int32_t a, int32_t b) { return counts[a] < counts[b]; });
+
+	// nodes 0..n-1 are the leaves, n + k is inner node k
+	std::vector<int64_t> weight(2 * std::max(n, 1) - 1);
+	std::vector<int32_t> parent(weight.size(), -1);
+	std::vector<uint8_t> binary(weight.size(), 0);
+	for (int32_t i = 0; i < n; i++) {
+		weight[i] = counts[i];
+	}
+	int32_t leaf = 0, inner = n;
+	for (int32_t k = n; k < 2 * n - 1; k++) {
+		// the queue of inner nodes holds [inner, k)
+		int32_t a = leaf < n && (inner == k || weight[leaves[leaf]] <= weight[inner]) ? leaves[leaf++] : inner++;
+		int32_t b = leaf < n && (inner == k || weight[leaves[leaf]] <= weight[inner]) ? leaves[leaf++] : inner++;
+		weight[k] = weight[a] + weight[b];
+		parent[a] = k;
+		parent[b] = k;
+		binary[b] = 1;
+	}
+
+	offsets_.resize(n + 1);
+	offsets_[0] = 0;
+	for (int32_t i = 0; i < n; i++) {
+		int32_t len = 0;
+		for (int32_t node = i; parent[node] >= 0; node = parent[node]) {
+			len++;
+		}
+		offsets_[i + 1] = offsets_[i] + len;
+		depth_ = std::max(depth_, len);
+	}
+	nodes_.resize(offsets_[n]);
+	codes_.resize(offsets_[n]);
+	for (int32_t i = 0; i < n; i++) {
+		int64_t pos = offsets_[i];
+		for (int32_t node = i; parent[node] >= 0; node = parent[node]) {
+			nodes_[pos] = parent[node] - n;
+			codes_[pos] = binary[node];
+			pos++;
+		}
+	}
+}
+
+/**
+* @Function: length of the longest path.
+*/
+int32_t HuffmanTree::depth() const {
+	return depth_;
+}
+
+/**
+* @Function: bytes of the paths.
+*/
+int64_t HuffmanTree::size() const {
+	return offsets_.size() * sizeof(int64_t) + nodes_.size() * (sizeof(int32_t) + sizeof(uint8_t));
+}
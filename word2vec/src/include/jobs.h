@@ -0,0 +1,257 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: jobs.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: several models trained together on one corpus, the words are
+*            counted once and the corpus is read and looked up once per epoch,
+*            every model trains on the same word ids with its own threads.
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "args.h"
+#include "dictionary.h"
+#include "corpus.h"
+#include "stream.h"
+#include "fasttext.h"
+
+class Jobs {
+  protected:
+	// tokens of a batch shared by the models
+	static const size_t BATCH_TOKENS = 1 << 16;
+
+	std::vector<Args> jobs_;
+
+	void check() const;
+	int32_t counter() const;
+	void count(Dictionary&, int32_t) const;
+	void read(const Dictionary&, const std::vector<std::shared_ptr<TokenQueue> >&) const;
+
+  public:
+	void parse(const std::string&, const std::vector<std::string>&);
+	void run();
+	const Args& job(size_t) const;
+};
+
+/**
+* @Function: one job per line of the spec, "model -option value ...", '#' starts
+*            a comment. the shared options come first and a job may override
+*            them. only the first job shows the progress line.
+*/
+void Jobs::parse(const std::string& spec, const std::vector<std::string>& shared) {
+	std::ifstream ifs(spec);
+	if (!ifs.is_open()) {
+		throw std::invalid_argument(spec + " cannot be opened for loading the jobs.");
+	}
+	std::string line;
+	while (std::getline(ifs, line)) {
+		line = line.substr(0, line.find('#'));
+		std::istringstream fields(line);
+		std::vector<std::string> args(1, "word2vec");
+		std::string field;
+		while (fields >> field) {
+			args.push_back(field);
+			if (args.size() == 2) {
+				args.insert(args.end(), shared.begin(), shared.end());
+			}
+		}
+		if (args.size() < 2) {
+			continue;
+		}
+		if (args[1] != "skipgram" && args[1] != "cbow" && args[1] != "subword" && args[1] != "substoke") {
+			throw std::invalid_argument(spec + ": " + args[1] + " is not a model.");
+		}
+		Args a;
+		a.parseArgs(args);
+		if (!jobs_.empty()) {
+			a.verbose = std::min(a.verbose, 1);
+		}
+		jobs_.push_back(a);
+	}
+	check();
+}
+
+/**
+* @Function: the jobs read one stream of word ids, so they share the corpus, its
+*            passes and the words kept.
+*/
+void Jobs::check() const {
+	if (jobs_.empty()) {
+		throw std::invalid_argument("The job spec has no jobs.");
+	}
+	for (size_t i = 0; i < jobs_.size(); i++) {
+		const Args& a = jobs_[i];
+		if (a.input != jobs_[0].input || a.epoch != jobs_[0].epoch || a.minCount != jobs_[0].minCount) {
+			throw std::invalid_argument("The jobs of a spec need the same -input, -epoch and -minCount.");
+		}
+		if (a.input == "-" || a.nodes > 1 || a.numa > 0 || a.incremental != "") {
+			throw std::invalid_argument("The jobs of a spec cannot use -input -, -nodes, -numa or -incremental.");
+		}
+		for (size_t j = 0; j < i; j++) {
+			if (a.output == jobs_[j].output) {
+				throw std::invalid_argument("Two jobs of the spec write " + a.output + ".");
+			}
+		}
+	}
+}
+
+const Args& Jobs::job(size_t i) const {
+	return jobs_[i];
+}
+
+/**
+* @Function: the job whose dictionary the counted words are, the first skipgram
+*            one. -1 when there is none, the words of a spec without one are
+*            counted without a -vocab cache since no job would load it.
+*/
+int32_t Jobs::counter() const {
+	for (size_t i = 0; i < jobs_.size(); i++) {
+		if (jobs_[i].model == model_name::skipgram) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/**
+* @Function: count the words once, the -vocab cache of job key is used if it
+*            has one.
+*/
+void Jobs::count(Dictionary& counted, int32_t key) const {
+	const std::string vocab = key >= 0 ? jobs_[key].vocab : std::string();
+	if (vocab != "" && counted.loadCache(vocab)) {
+		return;
+	}
+	Corpus ifs(jobs_[0].input);
+	if (!ifs.is_open()) {
+		throw std::invalid_argument(jobs_[0].input + " cannot be opened for training!");
+	}
+	counted.readFromFile(ifs);
+	ifs.close();
+	if (vocab != "") {
+		counted.saveCache(vocab);
+	}
+}
+
+/**
+* @Function: read the corpus -epoch times, every batch of word ids goes to the
+*            queue of every model. a model behind by a full queue holds the
+*            reader, so the models advance together.
+*/
+void Jobs::read(const Dictionary& counted, const std::vector<std::shared_ptr<TokenQueue> >& queues) const {
+	TRACE_SCOPE("readJobs");
+	Corpus ifs(jobs_[0].input);
+	if (!ifs.is_open()) {
+		throw std::invalid_argument(jobs_[0].input + " cannot be opened for training!");
+	}
+	for (int32_t epoch = 0; epoch < jobs_[0].epoch; epoch++) {
+		ifs.clear();
+		ifs.seekg(std::streampos(0));
+		std::shared_ptr<TokenBatch> batch;
+		while (true) {
+			if (!batch) {
+				batch = std::make_shared<TokenBatch>();
+				batch->words.reserve(BATCH_TOKENS);
+				batch->lines.push_back(0);
+			}
+			const size_t start = batch->words.size();
+			const bool more = counted.readLine(ifs, batch->words);
+			if (more) {
+				// a long line is cut into lines getLine trains whole
+				for (size_t end = start + Dictionary::MAX_LINE_SIZE; end < batch->words.size(); end += Dictionary::MAX_LINE_SIZE) {
+					batch->lines.push_back(end);
+				}
+				batch->lines.push_back(batch->words.size());
+			}
+			if (batch->lines.size() > 1 && (!more || batch->words.size() >= BATCH_TOKENS)) {
+				for (size_t i = 0; i < queues.size(); i++) {
+					queues[i]->push(batch);
+				}
+				batch.reset();
+			}
+			if (!more) {
+				break;
+			}
+		}
+	}
+	for (size_t i = 0; i < queues.size(); i++) {
+		queues[i]->close();
+	}
+}
+
+/**
+* @Function: count the words, start every model on its threads, read the corpus
+*            on this one and save every model when it is done. a model that
+*            fails closes its queue and the others go on, a failed read closes
+*            every queue and no model is saved. the first error is rethrown
+*            once the threads are joined.
+*/
+void Jobs::run() {
+	Trace::setCapacity(jobs_[0].traceEvents);
+	// the words are counted as for skipgram, every model adds its own features
+	const int32_t key = counter();
+	Args base = jobs_[key >= 0 ? key : 0];
+	base.model = model_name::skipgram;
+	base.hash = false;
+	Dictionary counted(std::make_shared<Args>(base));
+	count(counted, key);
+
+	std::cout << "Training " << jobs_.size() << " models from " << base.input << std::endl;
+	std::vector<std::shared_ptr<TokenQueue> > queues;
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < jobs_.size(); i++) {
+		queues.push_back(std::make_shared<TokenQueue>(4 * jobs_[i].thread));
+	}
+	std::mutex mutex;
+	std::exception_ptr error;
+	std::atomic<bool> stopped(false);
+	for (size_t i = 0; i < jobs_.size(); i++) {
+		threads.push_back(std::thread([&, i]() {
+			try {
+				FastText fasttext;
+				fasttext.train(jobs_[i], counted, queues[i]);
+				if (!stopped) {
+					fasttext.saveVectors();
+					fasttext.saveModel();
+				}
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!error) {
+					error = std::current_exception();
+				}
+				queues[i]->close();
+			}
+		}));
+	}
+	try {
+		read(counted, queues);
+	} catch (...) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!error) {
+			error = std::current_exception();
+		}
+		stopped = true;
+		for (size_t i = 0; i < queues.size(); i++) {
+			queues[i]->close();
+		}
+	}
+	for (size_t i = 0; i < threads.size(); i++) {
+		threads[i].join();
+	}
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
@@ -0,0 +1,255 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: lexicon.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: stroke lexicon indexed by code point. the compiled form is one blob
+*            which is memory mapped, so processes share it, and a character is
+*            looked up in O(1).
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Utf.h"
+
+/*
+  blob layout, all integers in host byte order:
+    LexiconHeader
+    uint32_t offsets[ncodepoints + 1]   strokes of code point c are [offsets[c], offsets[c + 1])
+    char     strokes[nbytes]
+*/
+struct LexiconHeader {
+	int32_t magic;
+	int32_t version;
+	uint32_t ncodepoints;
+	uint32_t nentries;
+	uint64_t nbytes;
+};
+
+class StrokeLexicon {
+  protected:
+	std::vector<char> owned_;
+	void* map_;
+	size_t mapSize_;
+	const LexiconHeader* header_;
+	const uint32_t* offsets_;
+	const char* strokes_;
+
+	void attach(const char*, size_t);
+	void release();
+
+  public:
+	static const int32_t MAGIC = 0x584c5763;
+	static const int32_t VERSION = 1;
+
+	StrokeLexicon();
+	StrokeLexicon(const StrokeLexicon&) = delete;
+	StrokeLexicon& operator=(const StrokeLexicon&) = delete;
+	~StrokeLexicon();
+
+	void build(std::istream&);
+	void load(const std::string&);
+	void save(std::ostream&) const;
+	void read(std::istream&);
+
+	size_t size() const;
+	bool find(uint32_t, const char*&, size_t&) const;
+	void strokes(const std::string&, std::string&) const;
+};
+
+StrokeLexicon::StrokeLexicon() : map_(NULL), mapSize_(0), header_(NULL), offsets_(NULL), strokes_(NULL) {}
+
+StrokeLexicon::~StrokeLexicon() {
+	release();
+}
+
+void StrokeLexicon::release() {
+	if (map_ != NULL) {
+		munmap(map_, mapSize_);
+		map_ = NULL;
+	}
+	std::vector<char>().swap(owned_);
+	header_ = NULL;
+	offsets_ = NULL;
+	strokes_ = NULL;
+}
+
+/**
+* @Function: point the lookup tables into a blob.
+*/
+void StrokeLexicon::attach(const char* blob, size_t size) {
+	header_ = (const LexiconHeader*)blob;
+	if (size < sizeof(LexiconHeader) || header_->magic != MAGIC || header_->version != VERSION
+		|| size != sizeof(LexiconHeader) + (header_->ncodepoints + 1) * sizeof(uint32_t) + header_->nbytes) {
+		throw std::invalid_argument("Stroke lexicon has wrong file format!");
+	}
+	offsets_ = (const uint32_t*)(blob + sizeof(LexiconHeader));
+	strokes_ = (const char*)(offsets_ + header_->ncodepoints + 1);
+}
+
+/**
+* @Function: build from the text feature file, one "character strokes" per line.
+*            spaces inside the strokes are dropped like Dictionary::trim did.
+*/
+void StrokeLexicon::build(std::istream& in) {
+	release();
+	std::vector<std::string> table;
+	std::string line;
+	uint32_t nentries = 0;
+	uint64_t nbytes = 0;
+	while (std::getline(in, line)) {
+		int pos = line.find_first_of(' ');
+		if (pos == -1) {
+			std::cerr << "Warning " << line << std::endl;
+			continue;
+		}
+		std::string word = line.substr(0, pos);
+		unsigned long int idx = 0;
+		uint32_t cp = decodeUTF8Character(word, idx);
+		if (idx != word.size()) {
+			std::cerr << "Warning, not one character: " << line << std::endl;
+			continue;
+		}
+		std::string feat;
+		for (size_t i = pos + 1; i < line.size(); i++) {
+			if (line[i] != ' ') feat.push_back(line[i]);
+		}
+		if (cp >= table.size()) {
+			table.resize(cp + 1);
+		}
+		if (table[cp].empty()) {
+			nentries++;
+		}
+		nbytes += feat.size() - table[cp].size();
+		table[cp] = feat;
+	}
+
+	LexiconHeader header;
+	header.magic = MAGIC;
+	header.version = VERSION;
+	header.ncodepoints = table.size();
+	header.nentries = nentries;
+	header.nbytes = nbytes;
+	owned_.resize(sizeof(LexiconHeader) + (table.size() + 1) * sizeof(uint32_t) + nbytes);
+	std::memcpy(owned_.data(), &header, sizeof(LexiconHeader));
+	uint32_t* offsets = (uint32_t*)(owned_.data() + sizeof(LexiconHeader));
+	char* strokes = (char*)(offsets + table.size() + 1);
+	uint32_t offset = 0;
+	for (size_t cp = 0; cp < table.size(); cp++) {
+		offsets[cp] = offset;
+		std::memcpy(strokes + offset, table[cp].data(), table[cp].size());
+		offset += table[cp].size();
+	}
+	offsets[table.size()] = offset;
+	attach(owned_.data(), owned_.size());
+}
+
+/**
+* @Function: map a compiled lexicon, or build one from a text feature file.
+*/
+void StrokeLexicon::load(const std::string& filename) {
+	std::ifstream ifs(filename, std::ifstream::binary);
+	if (!ifs.is_open()) {
+		throw std::invalid_argument(filename + " cannot be opened for loading stroke feature!");
+	}
+	int32_t magic = 0;
+	ifs.read((char*)&magic, sizeof(int32_t));
+	if (!ifs || magic != MAGIC) {
+		ifs.clear();
+		ifs.seekg(std::streampos(0));
+		build(ifs);
+		return;
+	}
+	ifs.close();
+	release();
+	int fd = open(filename.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		if (fd >= 0) close(fd);
+		throw std::invalid_argument(filename + " cannot be opened for loading stroke feature!");
+	}
+	mapSize_ = st.st_size;
+	map_ = mmap(NULL, mapSize_, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map_ == MAP_FAILED) {
+		map_ = NULL;
+		throw std::runtime_error(filename + " cannot be mapped.");
+	}
+	attach((const char*)map_, mapSize_);
+}
+
+/**
+* @Function: write the blob, it can be mapped by load() or read back by read().
+*/
+void StrokeLexicon::save(std::ostream& out) const {
+	if (header_ == NULL) {
+		LexiconHeader header = { MAGIC, VERSION, 0, 0, 0 };
+		uint32_t offset = 0;
+		out.write((char*)&header, sizeof(LexiconHeader));
+		out.write((char*)&offset, sizeof(uint32_t));
+		return;
+	}
+	out.write((const char*)header_, sizeof(LexiconHeader)
+		+ (header_->ncodepoints + 1) * sizeof(uint32_t) + header_->nbytes);
+}
+
+/**
+* @Function: read a blob written by save() into memory.
+*/
+void StrokeLexicon::read(std::istream& in) {
+	release();
+	LexiconHeader header;
+	in.read((char*)&header, sizeof(LexiconHeader));
+	if (!in || header.magic != MAGIC) {
+		throw std::invalid_argument("Stroke lexicon has wrong file format!");
+	}
+	owned_.resize(sizeof(LexiconHeader) + (header.ncodepoints + 1) * sizeof(uint32_t) + header.nbytes);
+	std::memcpy(owned_.data(), &header, sizeof(LexiconHeader));
+	in.read(owned_.data() + sizeof(LexiconHeader), owned_.size() - sizeof(LexiconHeader));
+	attach(owned_.data(), owned_.size());
+}
+
+/**
+* @Function: number of characters with strokes.
+*/
+size_t StrokeLexicon::size() const {
+	return header_ == NULL ? 0 : header_->nentries;
+}
+
+/**
+* @Function: strokes of one code point.
+*/
+bool StrokeLexicon::find(uint32_t cp, const char*& s, size_t& n) const {
+	if (header_ == NULL || cp >= header_->ncodepoints) {
+		return false;
+	}
+	s = strokes_ + offsets_[cp];
+	n = offsets_[cp + 1] - offsets_[cp];
+	return n > 0;
+}
+
+/**
+* @Function: append the strokes of every character of word to out,
+*            out only allocates when it has to grow.
+*/
+void StrokeLexicon::strokes(const std::string& word, std::string& out) const {
+	const char* s;
+	size_t n;
+	for (UTF8Iterator it(word); !it.done(); it.next()) {
+		if (find(it.codepoint(), s, n)) {
+			out.append(s, n);
+		}
+	}
+}
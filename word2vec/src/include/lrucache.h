@@ -0,0 +1,65 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: lrucache.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: least recently used cache from a word to its printed vector.
+*/
+
+#pragma once
+
+#include <list>
+#include <string>
+#include <utility>
+#include <unordered_map>
+
+class LRUCache {
+  protected:
+	typedef std::list<std::pair<std::string, std::string> > Items;
+	Items items_;
+	std::unordered_map<std::string, Items::iterator> index_;
+	size_t capacity_;
+
+  public:
+	int64_t hits;
+	int64_t misses;
+
+	explicit LRUCache(size_t);
+	bool get(const std::string&, std::string&);
+	void put(const std::string&, const std::string&);
+};
+
+/**
+* @Function: initial LRUCache with the max number of entries.
+*/
+LRUCache::LRUCache(size_t capacity) : capacity_(capacity), hits(0), misses(0) {}
+
+/**
+* @Function: look a word up and mark it as most recently used.
+*/
+bool LRUCache::get(const std::string& key, std::string& value) {
+	auto it = index_.find(key);
+	if (it == index_.end()) {
+		misses++;
+		return false;
+	}
+	items_.splice(items_.begin(), items_, it->second);
+	value = it->second->second;
+	hits++;
+	return true;
+}
+
+/**
+* @Function: insert a word, the least recently used one is dropped when full.
+*/
+void LRUCache::put(const std::string& key, const std::string& value) {
+	if (capacity_ == 0) {
+		return;
+	}
+	if (items_.size() >= capacity_) {
+		index_.erase(items_.back().first);
+		items_.pop_back();
+	}
+	items_.push_front(std::make_pair(key, value));
+	index_[key] = items_.begin();
+}
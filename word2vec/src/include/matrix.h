@@ -30,6 +30,8 @@ class Matrix {
     std::vector<real> data_;
     const int64_t m_;
     const int64_t n_;
+    // rows written by addRow since the last clearTouched(), empty if not tracked
+    std::vector<uint8_t> touched_;
 
   public:
     Matrix() : Matrix(0, 0) {}
@@ -100,6 +102,45 @@ class Matrix {
         for (int64_t j = 0; j < n_; j++) {
             data_[i * n_ + j] += a * vec[j];
         }
+        if (!touched_.empty()) {
+            touched_[i] = 1;
+        }
+    }
+
+    // same as addRow, DIM > 0 gives the loop a constant trip count so it is
+    // unrolled and vectorized, DIM == 0 falls back to the runtime n_
+    template <int32_t DIM>
+    void addRow(const real* vec, int64_t i, real a) {
+        assert(i >= 0);
+        assert(i < m_);
+        assert(DIM == 0 || DIM == n_);
+        const int64_t n = DIM > 0 ? DIM : n_;
+        real* row = data_.data() + i * n;
+        for (int64_t j = 0; j < n; j++) {
+            row[j] += a * vec[j];
+        }
+        if (!touched_.empty()) {
+            touched_[i] = 1;
+        }
+    }
+
+    // for kernels writing data() directly
+    inline void touch(int64_t i) {
+        if (!touched_.empty()) {
+            touched_[i] = 1;
+        }
+    }
+
+    void trackRows() {
+        touched_.assign(m_, 0);
+    }
+
+    inline bool touched(int64_t i) const {
+        return !touched_.empty() && touched_[i];
+    }
+
+    void clearTouched(int64_t i) {
+        touched_[i] = 0;
     }
 
     void multiplyRow(const std::vector<real>& nums, int64_t ib, int64_t ie) {
@@ -223,6 +264,15 @@ class Vector {
         }
     }
 
+    template <int32_t DIM>
+    void mul(real a) {
+        const int64_t n = DIM > 0 ? DIM : size();
+        real* v = data_.data();
+        for (int64_t i = 0; i < n; i++) {
+            v[i] *= a;
+        }
+    }
+
     void addVector(const Vector& source) {
         assert(size() == source.size());
         for (int64_t i = 0; i < size(); i++) {
@@ -246,6 +296,19 @@ class Vector {
         }
     }
 
+    template <int32_t DIM>
+    void addRow(const Matrix& A, int64_t i) {
+        assert(i >= 0);
+        assert(i < A.size(0));
+        assert(DIM == 0 || DIM == A.size(1));
+        const int64_t n = DIM > 0 ? DIM : A.size(1);
+        const real* row = A.data() + i * n;
+        real* v = data_.data();
+        for (int64_t j = 0; j < n; j++) {
+            v[j] += row[j];
+        }
+    }
+
     void addRow(const Matrix& A, int64_t i, real a) {
         assert(i >= 0);
         assert(i < A.size(0));
@@ -16,11 +16,28 @@
 #include "args.h"
 #include "matrix.h"
 #include "real.h"
+#include "random.h"
+#include "trace.h"
+#include "huffman.h"
 
 #include <iostream>
 #include <assert.h>
 #include <algorithm>
 #include <stdexcept>
+#include <cstring>
+#include <cmath>
+
+// counters of the delayed input gradients, -delaySentences
+struct DelayStats {
+	// gradients added to a buffered row
+	int64_t updates;
+	// buffered rows added to the shared input matrix
+	int64_t writes;
+	// flushes of the whole buffer after -delaySentences lines
+	int64_t flushes;
+	// rows written early after -delayCap gradients
+	int64_t capped;
+};
 
 class Model {
 protected:
@@ -30,6 +47,8 @@ protected:
 	Vector hidden_;
 	Vector output_;
 	Vector grad_;
+	// input gradient summed over the contexts of updateWindow
+	Vector windowGrad_;
 	int32_t hsz_;
 	int32_t osz_;
 	real loss_;
@@ -39,8 +58,22 @@ protected:
 	// negative sampling
 	std::vector<int32_t> negatives_;
 	size_t negpos;
+	// rows and scores of the target and its negatives in negativeSampling
+	std::vector<int32_t> rows_;
+	std::vector<real> scores_;
+	// delayed input gradients: the buffer slot of every input row or -1,
+	// the rows, their pending gradient count and their summed gradients
+	std::vector<int32_t> slot_;
+	std::vector<int32_t> pendingRows_;
+	std::vector<int32_t> pendingCount_;
+	std::vector<real> pending_;
+	int32_t pendingLines_;
+	DelayStats delayStats_;
+	// hierarchical softmax, shared by the models of all threads
+	std::shared_ptr<const HuffmanTree> tree_;
 	
 	int32_t getNegative(int32_t target);
+	template <int32_t DIM> void addInput(const real*, int32_t);
 	void initSigmoid();
 	void initLog();
 
@@ -51,19 +84,30 @@ public:
 	
 	real binaryLogistic(int32_t, bool, real);
 	real negativeSampling(int32_t, real);
+	template <int32_t DIM> real negativeSampling(int32_t, real);
+	real hierarchicalSoftmax(int32_t, real);
+	template <int32_t DIM> real hierarchicalSoftmax(int32_t, real);
 
 	void update(const std::vector<int32_t>&, int32_t, real);
+	template <int32_t DIM> void update(const std::vector<int32_t>&, int32_t, real);
+	template <int32_t DIM> void updateWindow(const std::vector<int32_t>&, const int32_t*, int32_t, real);
 	void updatePara(const std::vector<int32_t>&, int32_t, real);
+	void endLine();
+	void flush();
+	const DelayStats& delayStats() const;
 	void computeHidden(const std::vector<int32_t>&, Vector&) const;
+	template <int32_t DIM> void computeHidden(const std::vector<int32_t>&, Vector&) const;
 
 	void setTargetCounts(const std::vector<int64_t>&);
+	void setTree(std::shared_ptr<const HuffmanTree>);
 	void initTableNegatives(const std::vector<int64_t>&);
 	real getLoss() const;
 	real sigmoid(real) const;
+	real fastSigmoid(real) const;
 	real log(real) const;
 	real std_log(real) const;
 
-	std::minstd_rand rng;
+	Random rng;
 };
 
 constexpr int64_t SIGMOID_TABLE_SIZE = 512;
@@ -76,7 +120,7 @@ constexpr int64_t LOG_TABLE_SIZE = 512;
 
 Model::Model(std::shared_ptr<Matrix> wi, std::shared_ptr<Matrix> wo, 
 	std::shared_ptr<Args> args, int32_t seed):hidden_(args->dim), 
-	output_(wo->size(0)), grad_(args->dim), rng(seed) {
+	output_(wo->size(0)), grad_(args->dim), windowGrad_(args->dim), rows_(args->neg + 1), scores_(args->neg + 1), rng(args->seed, seed) {
 	wi_ = wi;
 	wo_ = wo;
 	args_ = args;
@@ -85,6 +129,11 @@ Model::Model(std::shared_ptr<Matrix> wi, std::shared_ptr<Matrix> wo,
 	negpos = 0;
 	loss_ = 0.0;
 	nexamples_ = 1;
+	pendingLines_ = 0;
+	delayStats_ = DelayStats();
+	if (args->delaySentences > 0) {
+		slot_.assign(wi->size(0), -1);
+	}
 	t_sigmoid_.reserve(SIGMOID_TABLE_SIZE + 1);
 	t_log_.reserve(LOG_TABLE_SIZE + 1);
 	initSigmoid();
@@ -121,6 +170,16 @@ void Model::setTargetCounts(const std::vector<int64_t>& counts) {
 	}
 }
 
+/**
+* @Function: use the Huffman tree of the targets for -loss hs.
+*/
+void Model::setTree(std::shared_ptr<const HuffmanTree> tree) {
+	tree_ = tree;
+	if (scores_.size() < size_t(tree_->depth())) {
+		scores_.resize(tree_->depth());
+	}
+}
+
 /**
 * @Function: initial Table negatives.
 */
@@ -141,19 +200,134 @@ void Model::initTableNegatives(const std::vector<int64_t>& counts) {
 /**
 * @Function: update.
 */
+void Model::update(const std::vector<int32_t>& input, int32_t target, real lr) {
+	update<0>(input, target, lr);
+}
+
+/**
+* @Function: update with the dimension known at compile time, DIM == 0 reads it
+*            from args_ instead.
+*/
+template <int32_t DIM>
 void Model::update(const std::vector<int32_t>& input, int32_t target, real lr) {
 	assert(target >= 0);
 	assert(target < osz_);
+	assert(DIM == 0 || DIM == hsz_);
 	if (input.size() == 0)
 		return;
-	computeHidden(input, hidden_);
+	computeHidden<DIM>(input, hidden_);
 	if (args_->loss == loss_name::ns) {
-		loss_ += negativeSampling(target, lr);
+		loss_ += negativeSampling<DIM>(target, lr);
+	} else if (args_->loss == loss_name::hs) {
+		loss_ += hierarchicalSoftmax<DIM>(target, lr);
 	}
 	nexamples_ += 1;
+	TRACE_SCOPE("update");
+	for (auto it = input.cbegin(); it != input.cend(); ++it) {
+		addInput<DIM>(grad_.data(), *it);
+	}
+}
+
+/**
+* @Function: update of one input against n targets, the hidden vector is
+*            computed once and the gradient of all targets is added to the
+*            input rows once, the rows are not updated between the targets.
+*/
+template <int32_t DIM>
+void Model::updateWindow(const std::vector<int32_t>& input, const int32_t* targets, int32_t n, real lr) {
+	if (input.size() == 0 || n == 0)
+		return;
+	const int64_t dim = DIM > 0 ? DIM : hsz_;
+	computeHidden<DIM>(input, hidden_);
+	real* sum = windowGrad_.data();
+	const real* grad = grad_.data();
+	windowGrad_.zero();
+	for (int32_t i = 0; i < n; i++) {
+		assert(targets[i] >= 0);
+		assert(targets[i] < osz_);
+		if (args_->loss == loss_name::ns) {
+			loss_ += negativeSampling<DIM>(targets[i], lr);
+		} else if (args_->loss == loss_name::hs) {
+			loss_ += hierarchicalSoftmax<DIM>(targets[i], lr);
+		}
+		for (int64_t j = 0; j < dim; j++) {
+			sum[j] += grad[j];
+		}
+	}
+	nexamples_ += n;
+	TRACE_SCOPE("update");
 	for (auto it = input.cbegin(); it != input.cend(); ++it) {
-		wi_->addRow(grad_.data_, *it, 1.0);
+		addInput<DIM>(sum, *it);
+	}
+}
+
+/**
+* @Function: add a gradient to an input row, with -delaySentences it is summed
+*            in the buffer of this thread and a row is written to the shared
+*            matrix once it holds -delayCap gradients or at the next flush.
+*/
+template <int32_t DIM>
+void Model::addInput(const real* grad, int32_t row) {
+	if (slot_.empty()) {
+		wi_->addRow<DIM>(grad, row, 1.0);
+		return;
+	}
+	const int64_t dim = DIM > 0 ? DIM : hsz_;
+	int32_t s = slot_[row];
+	if (s < 0) {
+		s = pendingRows_.size();
+		slot_[row] = s;
+		pendingRows_.push_back(row);
+		pendingCount_.push_back(0);
+		pending_.resize(pending_.size() + dim, 0.0);
+	}
+	real* sum = pending_.data() + int64_t(s) * dim;
+	for (int64_t j = 0; j < dim; j++) {
+		sum[j] += grad[j];
+	}
+	delayStats_.updates++;
+	if (++pendingCount_[s] >= args_->delayCap) {
+		wi_->addRow<DIM>(sum, row, 1.0);
+		std::fill(sum, sum + dim, 0.0);
+		pendingCount_[s] = 0;
+		delayStats_.writes++;
+		delayStats_.capped++;
+	}
+}
+
+/**
+* @Function: the end of a training line, the buffer is flushed every
+*            -delaySentences lines.
+*/
+void Model::endLine() {
+	if (!slot_.empty() && ++pendingLines_ >= args_->delaySentences) {
+		flush();
+	}
+}
+
+/**
+* @Function: write every buffered row to the shared input matrix.
+*/
+void Model::flush() {
+	if (slot_.empty()) {
+		return;
+	}
+	for (size_t s = 0; s < pendingRows_.size(); s++) {
+		if (pendingCount_[s] > 0) {
+			wi_->addRow<0>(pending_.data() + int64_t(s) * hsz_, pendingRows_[s], 1.0);
+			delayStats_.writes++;
+		}
+		slot_[pendingRows_[s]] = -1;
 	}
+	pendingRows_.clear();
+	pendingCount_.clear();
+	pending_.clear();
+	pendingLines_ = 0;
+	delayStats_.flushes++;
+}
+
+const DelayStats& Model::delayStats() const {
+	return delayStats_;
 }
 
 void Model::updatePara(const std::vector<int32_t>& input, int32_t target, real lr) {
@@ -177,26 +351,133 @@ void Model::updatePara(const std::vector<int32_t>& input, int32_t target, real l
 * @Function: conpute hidden.
 */
 void Model::computeHidden(const std::vector<int32_t>& input, Vector& hidden) const {
+	computeHidden<0>(input, hidden);
+}
+
+template <int32_t DIM>
+void Model::computeHidden(const std::vector<int32_t>& input, Vector& hidden) const {
+	TRACE_SCOPE("computeHidden");
 	assert(hidden.size() == hsz_);
 	hidden.zero();
 	for (auto it = input.cbegin(); it != input.cend(); ++it) {
-		hidden.addRow(*wi_, *it);
+		hidden.addRow<DIM>(*wi_, *it);
 	}
-	hidden.mul(1.0 / input.size());
+	hidden.mul<DIM>(1.0 / input.size());
 }
 
 /**
-* @Function: negative Sampling.
+* @Function: negative Sampling, same as binaryLogistic for the target and neg
+*            negatives but fused: all neg + 1 scores are computed in one pass
+*            over hidden_, then every row is read once to update grad_ and itself.
 */
 real Model::negativeSampling(int32_t target, real lr) {
+	return negativeSampling<0>(target, lr);
+}
+
+template <int32_t DIM>
+real Model::negativeSampling(int32_t target, real lr) {
+	TRACE_SCOPE("negativeSampling");
+	const int32_t n = args_->neg + 1;
+	const int64_t dim = DIM > 0 ? DIM : hsz_;
+	const real* hidden = hidden_.data();
+	real* grad = grad_.data();
+	real* wo = wo_->data();
+
+	rows_[0] = target;
+	for (int32_t k = 1; k < n; k++) {
+		rows_[k] = getNegative(target);
+	}
+	for (int32_t k = 0; k < n; k++) {
+		scores_[k] = 0.0;
+	}
+	for (int64_t j = 0; j < dim; j++) {
+		const real h = hidden[j];
+		for (int32_t k = 0; k < n; k++) {
+			scores_[k] += wo[rows_[k] * dim + j] * h;
+		}
+	}
+
 	real loss = 0.0;
+	for (int32_t k = 0; k < n; k++) {
+		if (std::isnan(scores_[k])) {
+			throw std::runtime_error("Encountered NaN.");
+		}
+		real score = fastSigmoid(scores_[k]);
+		if (k == 0) {
+			loss -= log(score);
+			scores_[k] = lr * (1.0 - score);
+		} else {
+			loss -= log(1.0 - score);
+			scores_[k] = lr * (0.0 - score);
+		}
+	}
+
 	grad_.zero();
-	for (int32_t n = 0; n <= args_->neg; n++) {
-		if (n == 0) {
-			loss += binaryLogistic(target, true, lr);
+	for (int32_t k = 0; k < n; k++) {
+		real* w = wo + rows_[k] * dim;
+		const real alpha = scores_[k];
+		for (int64_t j = 0; j < dim; j++) {
+			grad[j] += alpha * w[j];
+			w[j] += alpha * hidden[j];
+		}
+		wo_->touch(rows_[k]);
+	}
+	return loss;
+}
+
+/**
+* @Function: hierarchical softmax, a binary logistic at every inner node on the
+*            path of the target, fused like negativeSampling.
+*/
+real Model::hierarchicalSoftmax(int32_t target, real lr) {
+	return hierarchicalSoftmax<0>(target, lr);
+}
+
+template <int32_t DIM>
+real Model::hierarchicalSoftmax(int32_t target, real lr) {
+	TRACE_SCOPE("hierarchicalSoftmax");
+	const int32_t n = tree_->length(target);
+	const int32_t* nodes = tree_->nodes(target);
+	const uint8_t* codes = tree_->codes(target);
+	const int64_t dim = DIM > 0 ? DIM : hsz_;
+	const real* hidden = hidden_.data();
+	real* grad = grad_.data();
+	real* wo = wo_->data();
+
+	for (int32_t k = 0; k < n; k++) {
+		scores_[k] = 0.0;
+	}
+	for (int64_t j = 0; j < dim; j++) {
+		const real h = hidden[j];
+		for (int32_t k = 0; k < n; k++) {
+			scores_[k] += wo[nodes[k] * dim + j] * h;
+		}
+	}
+
+	real loss = 0.0;
+	for (int32_t k = 0; k < n; k++) {
+		if (std::isnan(scores_[k])) {
+			throw std::runtime_error("Encountered NaN.");
+		}
+		real score = fastSigmoid(scores_[k]);
+		if (codes[k]) {
+			loss -= log(score);
+			scores_[k] = lr * (1.0 - score);
 		} else {
-			loss += binaryLogistic(getNegative(target), false, lr);
+			loss -= log(1.0 - score);
+			scores_[k] = lr * (0.0 - score);
+		}
+	}
+
+	grad_.zero();
+	for (int32_t k = 0; k < n; k++) {
+		real* w = wo + nodes[k] * dim;
+		const real alpha = scores_[k];
+		for (int64_t j = 0; j < dim; j++) {
+			grad[j] += alpha * w[j];
+			w[j] += alpha * hidden[j];
 		}
+		wo_->touch(nodes[k]);
 	}
 	return loss;
 }
@@ -253,6 +534,39 @@ real Model::std_log(real x) const {
 	return std::log(x + 1e-5);
 }
 
+/**
+* @Function: exp() on floats, 2^i * 2^f with |f| <= 0.5 and a polynomial for 2^f,
+*            relative error about 2e-7 and no branch or table, so loops over it vectorize.
+*/
+inline real fastExp(real x) {
+	real t = x * real(1.4426950408889634);
+	real i = std::floor(t + real(0.5));
+	real f = t - i;
+	real p = real(1.535336188319500e-4);
+	p = p * f + real(1.339887440266574e-3);
+	p = p * f + real(9.618437357674640e-3);
+	p = p * f + real(5.550332471162809e-2);
+	p = p * f + real(2.402264791363012e-1);
+	p = p * f + real(6.931472028550421e-1);
+	p = p * f + real(1.0);
+	int32_t bits = (int32_t(i) + 127) << 23;
+	real scale;
+	std::memcpy(&scale, &bits, sizeof(real));
+	return p * scale;
+}
+
+/**
+* @Function: sigmoid() without the table, clamped to [-MAX_SIGMOID, MAX_SIGMOID] like sigmoid().
+*/
+real Model::fastSigmoid(real x) const {
+	if (x < -MAX_SIGMOID) {
+		return 0.0;
+	} else if (x > MAX_SIGMOID) {
+		return 1.0;
+	}
+	return 1.0 / (1.0 + fastExp(-x));
+}
+
 /**
 * @Function: sigmoid().
 */
@@ -0,0 +1,249 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: numa.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: NUMA replicated training, threads are pinned per node, every node
+*            trains its own node-local copy of the matrices and the copies are
+*            averaged periodically.
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "args.h"
+#include "matrix.h"
+#include "real.h"
+
+class NumaReplicas {
+  protected:
+	std::shared_ptr<Args> args_;
+	// cpus_[node] are the cpus threads of that node are pinned to
+	std::vector<std::vector<int32_t> > cpus_;
+	// mats_[0] are the input replicas, mats_[1] the output replicas
+	std::vector<std::vector<std::shared_ptr<Matrix> > > mats_;
+	std::unique_ptr<std::atomic<int64_t>[]> tokens_;
+	std::chrono::steady_clock::time_point start_;
+	int64_t rounds_;
+	int64_t round_;
+
+	void detectNodes();
+	void reconcile();
+
+  public:
+	NumaReplicas(std::shared_ptr<Args>, std::shared_ptr<Matrix>, std::shared_ptr<Matrix>);
+
+	int32_t nodes() const;
+	int32_t nodeOf(int32_t) const;
+	void pin(int32_t) const;
+	std::shared_ptr<Matrix> input(int32_t) const;
+	std::shared_ptr<Matrix> output(int32_t) const;
+	void addTokens(int32_t, int64_t);
+
+	void start(int64_t);
+	void step(real);
+	void finish();
+	void printInfo(std::ostream&) const;
+};
+
+/**
+* @Function: initial replicas, each one is copied by a thread pinned to its node
+*            so the pages are first touched, and placed, on that node.
+*/
+NumaReplicas::NumaReplicas(std::shared_ptr<Args> args, std::shared_ptr<Matrix> input,
+	std::shared_ptr<Matrix> output) : args_(args) {
+	detectNodes();
+	int32_t n = nodes();
+	mats_.assign(2, std::vector<std::shared_ptr<Matrix> >(n));
+	tokens_.reset(new std::atomic<int64_t>[n]);
+	std::vector<std::thread> threads;
+	for (int32_t k = 0; k < n; k++) {
+		tokens_[k] = 0;
+		threads.push_back(std::thread([=]() {
+			pin(k);
+			mats_[0][k] = std::make_shared<Matrix>(*input);
+			mats_[1][k] = std::make_shared<Matrix>(*output);
+			mats_[0][k]->trackRows();
+			mats_[1][k]->trackRows();
+		}));
+	}
+	for (int32_t k = 0; k < n; k++) {
+		threads[k].join();
+	}
+	rounds_ = 1;
+	round_ = 0;
+}
+
+/**
+* @Function: read the cpus of every node from sysfs, without sysfs or with
+*            fewer nodes than asked the online cpus are split evenly.
+*/
+void NumaReplicas::detectNodes() {
+	cpus_.clear();
+	for (int32_t k = 0; k < args_->numa; k++) {
+		std::ifstream ifs("/sys/devices/system/node/node" + std::to_string(k) + "/cpulist");
+		std::string list;
+		if (!ifs.is_open() || !std::getline(ifs, list)) {
+			break;
+		}
+		std::vector<int32_t> cpus;
+		std::stringstream ss(list);
+		std::string range;
+		while (std::getline(ss, range, ',')) {
+			size_t dash = range.find('-');
+			int32_t first = std::stoi(range.substr(0, dash));
+			int32_t last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+			for (int32_t c = first; c <= last; c++) {
+				cpus.push_back(c);
+			}
+		}
+		cpus_.push_back(cpus);
+	}
+	if (cpus_.size() == args_->numa) {
+		return;
+	}
+	std::cerr << "Warning: found " << cpus_.size() << " numa nodes, splitting cpus into "
+		<< args_->numa << " groups instead." << std::endl;
+	cpus_.assign(args_->numa, std::vector<int32_t>());
+	int32_t ncpus = std::max<int32_t>(1, std::thread::hardware_concurrency());
+	for (int32_t c = 0; c < ncpus; c++) {
+		cpus_[c * args_->numa / ncpus].push_back(c);
+	}
+}
+
+int32_t NumaReplicas::nodes() const {
+	return cpus_.size();
+}
+
+/**
+* @Function: consecutive threads share a node.
+*/
+int32_t NumaReplicas::nodeOf(int32_t threadId) const {
+	return threadId * nodes() / args_->thread;
+}
+
+/**
+* @Function: pin the calling thread to the cpus of a node.
+*/
+void NumaReplicas::pin(int32_t node) const {
+#ifdef __linux__
+	if (cpus_[node].empty()) {
+		return;
+	}
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (size_t i = 0; i < cpus_[node].size(); i++) {
+		CPU_SET(cpus_[node][i], &set);
+	}
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+std::shared_ptr<Matrix> NumaReplicas::input(int32_t node) const {
+	return mats_[0][node];
+}
+
+std::shared_ptr<Matrix> NumaReplicas::output(int32_t node) const {
+	return mats_[1][node];
+}
+
+void NumaReplicas::addTokens(int32_t node, int64_t ntokens) {
+	tokens_[node] += ntokens;
+}
+
+/**
+* @Function: average the replicas every ntokens / syncRate tokens.
+*/
+void NumaReplicas::start(int64_t ntokens) {
+	start_ = std::chrono::steady_clock::now();
+	rounds_ = std::max<int64_t>(1, ntokens / args_->syncRate);
+}
+
+/**
+* @Function: average every row touched in any replica since the last round.
+*/
+void NumaReplicas::reconcile() {
+	const int32_t n = nodes();
+	const real scale = 1.0 / n;
+	for (size_t m = 0; m < mats_.size(); m++) {
+		std::vector<std::shared_ptr<Matrix> >& reps = mats_[m];
+		const int64_t dim = reps[0]->cols();
+		std::vector<real> avg(dim);
+		for (int64_t i = 0; i < reps[0]->rows(); i++) {
+			bool touched = false;
+			for (int32_t k = 0; k < n; k++) {
+				if (reps[k]->touched(i)) {
+					reps[k]->clearTouched(i);
+					touched = true;
+				}
+			}
+			if (!touched)
+				continue;
+			std::fill(avg.begin(), avg.end(), 0.0);
+			for (int32_t k = 0; k < n; k++) {
+				for (int64_t j = 0; j < dim; j++) {
+					avg[j] += reps[k]->at(i, j);
+				}
+			}
+			for (int32_t k = 0; k < n; k++) {
+				for (int64_t j = 0; j < dim; j++) {
+					reps[k]->at(i, j) = avg[j] * scale;
+				}
+			}
+		}
+	}
+	round_++;
+}
+
+/**
+* @Function: run the rounds that are due at this training progress.
+*/
+void NumaReplicas::step(real progress) {
+	int64_t due = std::min<int64_t>(rounds_ - 1, int64_t(progress * rounds_));
+	while (round_ < due) {
+		reconcile();
+	}
+}
+
+/**
+* @Function: the last round runs after all threads stopped, the replicas are equal afterwards.
+*/
+void NumaReplicas::finish() {
+	while (round_ < rounds_) {
+		reconcile();
+	}
+}
+
+/**
+* @Function: tokens per second of every node.
+*/
+void NumaReplicas::printInfo(std::ostream& log_stream) const {
+	double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+	int64_t total = 0;
+	for (int32_t k = 0; k < nodes(); k++) {
+		int32_t nthreads = 0;
+		for (int32_t i = 0; i < args_->thread; i++) {
+			if (nodeOf(i) == k) nthreads++;
+		}
+		log_stream << "Numa node " << k << ": " << nthreads << " threads, "
+			<< int64_t(tokens_[k] / t) << " words/sec" << std::endl;
+		total += tokens_[k];
+	}
+	log_stream << "Numa replicas: " << round_ << " sync rounds, "
+		<< int64_t(total / t) << " words/sec" << std::endl;
+}
@@ -0,0 +1,106 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: random.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: xoshiro256** generator of the training threads, every thread has its
+*            own stream derived from -seed, window sizes and subsampling draws
+*            are produced a line at a time.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <limits>
+
+class Random {
+  protected:
+	uint64_t s_[4];
+	// batches handed out by uniform32() and windows(), valid until the next call
+	std::vector<uint32_t> bits_;
+	std::vector<int32_t> windows_;
+
+	static inline uint64_t rotl(uint64_t x, int k) {
+		return (x << k) | (x >> (64 - k));
+	}
+
+	static inline uint64_t splitmix64(uint64_t& x) {
+		uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		return z ^ (z >> 31);
+	}
+
+  public:
+	typedef uint64_t result_type;
+
+	Random(uint64_t, uint64_t);
+
+	static constexpr result_type min() {
+		return 0;
+	}
+	static constexpr result_type max() {
+		return std::numeric_limits<uint64_t>::max();
+	}
+
+	inline uint64_t operator()() {
+		const uint64_t result = rotl(s_[1] * 5, 7) * 9;
+		const uint64_t t = s_[1] << 17;
+		s_[2] ^= s_[0];
+		s_[3] ^= s_[1];
+		s_[1] ^= s_[2];
+		s_[0] ^= s_[3];
+		s_[2] ^= t;
+		s_[3] = rotl(s_[3], 45);
+		return result;
+	}
+
+	const uint32_t* uniform32(size_t);
+	const int32_t* windows(int32_t, size_t);
+};
+
+/**
+* @Function: the state of stream is seeded by splitmix64, equal seed and
+*            stream give an equal sequence on every run.
+*/
+Random::Random(uint64_t seed, uint64_t stream) {
+	uint64_t x = seed ^ (stream * 0xd1342543de82ef95ULL + 0x2545f4914f6cdd1dULL);
+	for (int i = 0; i < 4; i++) {
+		s_[i] = splitmix64(x);
+	}
+}
+
+/**
+* @Function: n uniform 32 bits integers, two of them per draw.
+*/
+const uint32_t* Random::uniform32(size_t n) {
+	if (bits_.size() < n) {
+		bits_.resize(n);
+	}
+	uint32_t* out = bits_.data();
+	size_t i = 0;
+	for (; i + 1 < n; i += 2) {
+		uint64_t r = (*this)();
+		out[i] = uint32_t(r >> 32);
+		out[i + 1] = uint32_t(r);
+	}
+	if (i < n) {
+		out[i] = uint32_t((*this)() >> 32);
+	}
+	return out;
+}
+
+/**
+* @Function: n window sizes uniform in [1, ws], by multiply and shift instead of modulo.
+*/
+const int32_t* Random::windows(int32_t ws, size_t n) {
+	if (windows_.size() < n) {
+		windows_.resize(n);
+	}
+	const uint32_t* r = uniform32(n);
+	for (size_t i = 0; i < n; i++) {
+		windows_[i] = int32_t((uint64_t(r[i]) * uint64_t(ws)) >> 32) + 1;
+	}
+	return windows_.data();
+}
@@ -0,0 +1,136 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: spacesaving.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: Space-Saving heavy hitters counter with a fixed number of counters,
+*            used to count the vocabulary of very large corpora in bounded memory.
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+class SpaceSaving {
+  protected:
+	struct Counter {
+		std::string word;
+		int64_t count;
+		int64_t error;
+		int32_t pos;
+	};
+	std::vector<Counter> counters_;
+	// min-heap of counter ids ordered by count
+	std::vector<int32_t> heap_;
+	std::unordered_map<std::string, int32_t> index_;
+	size_t capacity_;
+
+	void swap(size_t, size_t);
+	void siftUp(size_t);
+	void siftDown(size_t);
+
+  public:
+	explicit SpaceSaving(size_t);
+
+	void add(const std::string&);
+	size_t size() const;
+	int64_t minCount() const;
+	void candidates(int64_t, std::vector<std::string>&) const;
+};
+
+/**
+* @Function: initial SpaceSaving with the number of counters.
+*/
+SpaceSaving::SpaceSaving(size_t capacity) : capacity_(capacity) {
+	counters_.reserve(capacity);
+	heap_.reserve(capacity);
+	index_.reserve(capacity);
+}
+
+void SpaceSaving::swap(size_t a, size_t b) {
+	std::swap(heap_[a], heap_[b]);
+	counters_[heap_[a]].pos = a;
+	counters_[heap_[b]].pos = b;
+}
+
+void SpaceSaving::siftUp(size_t i) {
+	while (i > 0) {
+		size_t parent = (i - 1) / 2;
+		if (counters_[heap_[parent]].count <= counters_[heap_[i]].count)
+			break;
+		swap(i, parent);
+		i = parent;
+	}
+}
+
+void SpaceSaving::siftDown(size_t i) {
+	const size_t n = heap_.size();
+	while (true) {
+		size_t smallest = i;
+		size_t l = 2 * i + 1;
+		size_t r = l + 1;
+		if (l < n && counters_[heap_[l]].count < counters_[heap_[smallest]].count) smallest = l;
+		if (r < n && counters_[heap_[r]].count < counters_[heap_[smallest]].count) smallest = r;
+		if (smallest == i)
+			break;
+		swap(i, smallest);
+		i = smallest;
+	}
+}
+
+/**
+* @Function: count one occurrence, a full counter set replaces the minimum counter.
+*/
+void SpaceSaving::add(const std::string& word) {
+	auto it = index_.find(word);
+	if (it != index_.end()) {
+		Counter& c = counters_[it->second];
+		c.count++;
+		siftDown(c.pos);
+		return;
+	}
+	if (counters_.size() < capacity_) {
+		int32_t id = counters_.size();
+		counters_.push_back(Counter{ word, 1, 0, int32_t(heap_.size()) });
+		heap_.push_back(id);
+		index_[word] = id;
+		siftUp(heap_.size() - 1);
+		return;
+	}
+	int32_t id = heap_[0];
+	Counter& c = counters_[id];
+	index_.erase(c.word);
+	c.word = word;
+	c.error = c.count;
+	c.count++;
+	index_[word] = id;
+	siftDown(0);
+}
+
+size_t SpaceSaving::size() const {
+	return counters_.size();
+}
+
+/**
+* @Function: the largest overestimate of any counter.
+*/
+int64_t SpaceSaving::minCount() const {
+	if (heap_.size() < capacity_ || heap_.empty())
+		return 0;
+	return counters_[heap_[0]].count;
+}
+
+/**
+* @Function: words which may occur at least threshold times, every such word
+*            is kept as long as threshold > minCount().
+*/
+void SpaceSaving::candidates(int64_t threshold, std::vector<std::string>& words) const {
+	words.clear();
+	for (size_t i = 0; i < counters_.size(); i++) {
+		if (counters_[i].count >= threshold) {
+			words.push_back(counters_[i].word);
+		}
+	}
+}
@@ -0,0 +1,261 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: stream.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: training text from stdin or a pipe, read once by one thread and
+*            handed to the training threads in batches of whole lines, and the
+*            word ids of a corpus read once for the models of a job spec.
+*/
+
+#pragma once
+
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <istream>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+
+class LineStream {
+  protected:
+	std::istream& in_;
+	// bytes per batch and batches queued before the reader waits
+	size_t batch_;
+	size_t capacity_;
+
+	std::deque<std::string> queue_;
+	std::mutex mutex_;
+	std::condition_variable notEmpty_;
+	std::condition_variable notFull_;
+	bool eof_;
+	std::thread reader_;
+
+	std::atomic<int64_t> bytes_;
+	std::atomic<int64_t> lines_;
+	// times the reader found the queue full, the trainers keep up with it
+	std::atomic<int64_t> full_;
+	// times a trainer found the queue empty, the stream is too slow
+	std::atomic<int64_t> empty_;
+
+	void read();
+	void push(std::string&);
+
+  public:
+	LineStream(std::istream&, size_t, size_t);
+	~LineStream();
+
+	bool pop(std::string&);
+	bool done();
+	int64_t bytes() const;
+	int64_t lines() const;
+	int64_t full() const;
+	int64_t empty() const;
+};
+
+LineStream::LineStream(std::istream& in, size_t batch, size_t capacity)
+	: in_(in), batch_(std::max<size_t>(batch, 1)), capacity_(std::max<size_t>(capacity, 1)), eof_(false),
+	bytes_(0), lines_(0), full_(0), empty_(0) {
+	reader_ = std::thread([this]() { read(); });
+}
+
+LineStream::~LineStream() {
+	{
+		// a reader blocked on a full queue is let go
+		std::lock_guard<std::mutex> lock(mutex_);
+		capacity_ = SIZE_MAX;
+	}
+	notFull_.notify_all();
+	if (reader_.joinable()) {
+		reader_.join();
+	}
+}
+
+/**
+* @Function: read blocks of the stream, a batch ends at the last newline of its
+*            block and the rest of the line starts the next batch.
+*/
+void LineStream::read() {
+	std::streambuf& sb = *in_.rdbuf();
+	std::string rest;
+	std::string block(batch_, '\0');
+	while (true) {
+		const std::streamsize n = sb.sgetn(&block[0], batch_);
+		if (n <= 0) {
+			break;
+		}
+		const size_t last = block.rfind('\n', n - 1);
+		if (last == std::string::npos) {
+			rest.append(block, 0, n);
+			continue;
+		}
+		std::string batch;
+		batch.swap(rest);
+		batch.append(block, 0, last + 1);
+		rest.assign(block, last + 1, n - last - 1);
+		push(batch);
+	}
+	if (!rest.empty()) {
+		rest.push_back('\n');
+		push(rest);
+	}
+	std::lock_guard<std::mutex> lock(mutex_);
+	eof_ = true;
+	notEmpty_.notify_all();
+}
+
+void LineStream::push(std::string& batch) {
+	bytes_ += batch.size();
+	lines_ += std::count(batch.begin(), batch.end(), '\n');
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (queue_.size() >= capacity_) {
+		full_++;
+		notFull_.wait(lock, [this]() { return queue_.size() < capacity_; });
+	}
+	queue_.push_back(std::string());
+	queue_.back().swap(batch);
+	notEmpty_.notify_one();
+}
+
+/**
+* @Function: the next batch of lines, false once the stream is over.
+*/
+bool LineStream::pop(std::string& batch) {
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (queue_.empty() && !eof_) {
+		empty_++;
+		notEmpty_.wait(lock, [this]() { return !queue_.empty() || eof_; });
+	}
+	if (queue_.empty()) {
+		return false;
+	}
+	batch.swap(queue_.front());
+	queue_.pop_front();
+	notFull_.notify_one();
+	return true;
+}
+
+/**
+* @Function: whether every batch has been taken.
+*/
+bool LineStream::done() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return eof_ && queue_.empty();
+}
+
+int64_t LineStream::bytes() const {
+	return bytes_;
+}
+
+int64_t LineStream::lines() const {
+	return lines_;
+}
+
+int64_t LineStream::full() const {
+	return full_;
+}
+
+int64_t LineStream::empty() const {
+	return empty_;
+}
+
+// word ids of whole lines, -1 out of the vocabulary, line i is [lines[i], lines[i + 1])
+struct TokenBatch {
+	std::vector<int32_t> words;
+	std::vector<int32_t> lines;
+};
+
+/**
+* @Function: batches of word ids for the threads of one model, the reader puts
+*            the same batch in the queue of every model.
+*/
+class TokenQueue {
+  protected:
+	size_t capacity_;
+	std::deque<std::shared_ptr<const TokenBatch> > queue_;
+	std::mutex mutex_;
+	std::condition_variable notEmpty_;
+	std::condition_variable notFull_;
+	bool closed_;
+
+	std::atomic<int64_t> full_;
+	std::atomic<int64_t> empty_;
+
+  public:
+	explicit TokenQueue(size_t);
+
+	void push(const std::shared_ptr<const TokenBatch>&);
+	void close();
+	bool pop(std::shared_ptr<const TokenBatch>&);
+	bool done();
+	int64_t full() const;
+	int64_t empty() const;
+};
+
+TokenQueue::TokenQueue(size_t capacity) : capacity_(std::max<size_t>(capacity, 1)), closed_(false), full_(0), empty_(0) {}
+
+/**
+* @Function: add a batch, waits while the model is capacity batches behind. a
+*            queue closed by a model that failed drops the batch.
+*/
+void TokenQueue::push(const std::shared_ptr<const TokenBatch>& batch) {
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (queue_.size() >= capacity_ && !closed_) {
+		full_++;
+		notFull_.wait(lock, [this]() { return queue_.size() < capacity_ || closed_; });
+	}
+	if (closed_) {
+		return;
+	}
+	queue_.push_back(batch);
+	notEmpty_.notify_one();
+}
+
+/**
+* @Function: no more batches, the threads stop once the queue is empty.
+*/
+void TokenQueue::close() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	closed_ = true;
+	notEmpty_.notify_all();
+	notFull_.notify_all();
+}
+
+/**
+* @Function: the next batch, false once the queue is closed and empty.
+*/
+bool TokenQueue::pop(std::shared_ptr<const TokenBatch>& batch) {
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (queue_.empty() && !closed_) {
+		empty_++;
+		notEmpty_.wait(lock, [this]() { return !queue_.empty() || closed_; });
+	}
+	if (queue_.empty()) {
+		return false;
+	}
+	batch = queue_.front();
+	queue_.pop_front();
+	notFull_.notify_one();
+	return true;
+}
+
+/**
+* @Function: whether every batch has been taken.
+*/
+bool TokenQueue::done() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return closed_ && queue_.empty();
+}
+
+int64_t TokenQueue::full() const {
+	return full_;
+}
+
+int64_t TokenQueue::empty() const {
+	return empty_;
+}
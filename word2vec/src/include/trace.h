@@ -0,0 +1,217 @@
+/**
+* @Author: bamtercelboo
+* @Date: 2026/10/19
+* @File: trace.h
+* @Contact: bamtercelboo@{gmail.com, 163.com}
+* @Function: scoped timers written as a Chrome trace (chrome://tracing, Perfetto).
+*            TRACE_SCOPE is compiled in only with -DW2V_TRACE, a scope reads the
+*            time stamp counter twice and appends to a buffer of its own thread.
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#ifdef W2V_TRACE
+#define W2V_TRACE_CAT(a, b) a##b
+#define W2V_TRACE_NAME(a, b) W2V_TRACE_CAT(a, b)
+#define TRACE_SCOPE(name) \
+	static const int32_t W2V_TRACE_NAME(trace_id_, __LINE__) = Trace::scope(name); \
+	TraceScope W2V_TRACE_NAME(trace_scope_, __LINE__)(W2V_TRACE_NAME(trace_id_, __LINE__))
+#else
+#define TRACE_SCOPE(name)
+#endif
+
+struct TraceEvent {
+	uint64_t begin;
+	uint64_t end;
+	int32_t scope;
+};
+
+// events of one thread, every scope is summed and its first events are kept
+struct TraceBuffer {
+	int32_t tid;
+	std::vector<TraceEvent> events;
+	int64_t dropped;
+	std::vector<uint64_t> ticks;
+	std::vector<int64_t> calls;
+};
+
+class Trace {
+  protected:
+	static const int32_t MAX_SCOPES = 64;
+
+	std::mutex mutex_;
+	std::vector<std::string> names_;
+	std::vector<std::unique_ptr<TraceBuffer> > buffers_;
+	size_t capacity_;
+	uint64_t ticks0_;
+	std::chrono::steady_clock::time_point time0_;
+
+	Trace();
+	static Trace& instance();
+	TraceBuffer* add();
+
+  public:
+	static inline uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	static int32_t scope(const char*);
+	static inline TraceBuffer& local() {
+		static thread_local TraceBuffer* buffer = NULL;
+		if (buffer == NULL) {
+			buffer = instance().add();
+		}
+		return *buffer;
+	}
+	static inline void record(int32_t id, uint64_t begin, uint64_t end) {
+		TraceBuffer& buffer = local();
+		buffer.ticks[id] += end - begin;
+		buffer.calls[id]++;
+		if (buffer.calls[id] <= instance().capacity_) {
+			TraceEvent e = { begin, end, id };
+			buffer.events.push_back(e);
+		} else {
+			buffer.dropped++;
+		}
+	}
+
+	static void setCapacity(size_t);
+	static void write(const std::string&, int32_t);
+};
+
+class TraceScope {
+  protected:
+	int32_t id_;
+	uint64_t begin_;
+
+  public:
+	explicit TraceScope(int32_t id) : id_(id), begin_(Trace::now()) {}
+	~TraceScope() {
+		Trace::record(id_, begin_, Trace::now());
+	}
+};
+
+Trace::Trace() : capacity_(100000), ticks0_(now()), time0_(std::chrono::steady_clock::now()) {}
+
+Trace& Trace::instance() {
+	static Trace trace;
+	return trace;
+}
+
+/**
+* @Function: id of a scope name, called once per TRACE_SCOPE.
+*/
+int32_t Trace::scope(const char* name) {
+	Trace& trace = instance();
+	std::lock_guard<std::mutex> lock(trace.mutex_);
+	for (size_t i = 0; i < trace.names_.size(); i++) {
+		if (trace.names_[i] == name) {
+			return i;
+		}
+	}
+	if (trace.names_.size() >= MAX_SCOPES) {
+		throw std::runtime_error(std::string("too many trace scopes at ") + name);
+	}
+	trace.names_.push_back(name);
+	return trace.names_.size() - 1;
+}
+
+/**
+* @Function: the buffer of a new thread, it outlives the thread until write().
+*/
+TraceBuffer* Trace::add() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	buffers_.emplace_back(new TraceBuffer());
+	TraceBuffer* buffer = buffers_.back().get();
+	buffer->tid = buffers_.size() - 1;
+	buffer->dropped = 0;
+	buffer->ticks.assign(MAX_SCOPES, 0);
+	buffer->calls.assign(MAX_SCOPES, 0);
+	return buffer;
+}
+
+/**
+* @Function: events kept per scope and thread, later ones are only summed.
+*/
+void Trace::setCapacity(size_t capacity) {
+	instance().capacity_ = capacity;
+}
+
+/**
+* @Function: write the events as Chrome trace JSON and print the time of every
+*            scope summed over the threads, nested scopes are included in their
+*            parents.
+*/
+void Trace::write(const std::string& path, int32_t pid) {
+#ifndef W2V_TRACE
+	std::cerr << "word2vec was built without -DW2V_TRACE=ON, " << path << " is not written." << std::endl;
+	return;
+#endif
+	Trace& trace = instance();
+	std::lock_guard<std::mutex> lock(trace.mutex_);
+	// time stamp counter ticks per microsecond over the whole run
+	double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - trace.time0_).count();
+	double perUs = (now() - trace.ticks0_) / std::max(elapsed, 1.0);
+	std::ofstream ofs(path);
+	if (!ofs.is_open()) {
+		throw std::invalid_argument(path + " cannot be opened for saving the trace.");
+	}
+	ofs << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+	bool first = true;
+	int64_t dropped = 0;
+	for (size_t t = 0; t < trace.buffers_.size(); t++) {
+		const TraceBuffer& buffer = *trace.buffers_[t];
+		ofs << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << buffer.tid
+			<< ",\"args\":{\"name\":\"thread " << buffer.tid << "\"}}";
+		first = false;
+		for (size_t i = 0; i < buffer.events.size(); i++) {
+			const TraceEvent& e = buffer.events[i];
+			ofs << ",\n{\"name\":\"" << trace.names_[e.scope] << "\",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << buffer.tid
+				<< ",\"ts\":" << (e.begin - trace.ticks0_) / perUs << ",\"dur\":" << (e.end - e.begin) / perUs << "}";
+		}
+		dropped += buffer.dropped;
+	}
+	ofs << "\n]}\n";
+	ofs.close();
+
+	std::cerr << "Trace written to " << path;
+	if (dropped > 0) {
+		std::cerr << ", " << dropped << " events over -traceEvents are only summed";
+	}
+	std::cerr << std::endl;
+	std::cerr << std::left << std::setw(20) << "scope" << std::right << std::setw(14) << "calls"
+		<< std::setw(14) << "seconds" << std::setw(16) << "ns/call" << std::endl;
+	for (size_t s = 0; s < trace.names_.size(); s++) {
+		uint64_t ticks = 0;
+		int64_t calls = 0;
+		for (size_t t = 0; t < trace.buffers_.size(); t++) {
+			ticks += trace.buffers_[t]->ticks[s];
+			calls += trace.buffers_[t]->calls[s];
+		}
+		double us = ticks / perUs;
+		std::cerr << std::left << std::setw(20) << trace.names_[s] << std::right << std::setw(14) << calls
+			<< std::setw(14) << std::setprecision(3) << us / 1e6
+			<< std::setw(16) << std::setprecision(1) << (calls > 0 ? 1000.0 * us / calls : 0.0) << std::endl;
+	}
+}
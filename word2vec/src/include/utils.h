@@ -10,6 +10,7 @@
 #pragma once
 
 #include <fstream>
+#include <string>
 
 #if defined(__clang__) || defined(__GNUC__)
 # define FASTTEXT_DEPRECATED(msg) __attribute__((__deprecated__(msg)))
@@ -21,14 +22,31 @@
 
 
 namespace utils {
-int64_t size(std::ifstream& ifs) {
+int64_t size(std::istream& ifs) {
     ifs.seekg(std::streamoff(0), std::ios::end);
     return ifs.tellg();
 }
 
-void seek(std::ifstream& ifs, int64_t pos) {
+void seek(std::istream& ifs, int64_t pos) {
     ifs.clear();
     ifs.seekg(std::streampos(pos));
 }
+
+// the bytes words are split on, a newline also ends the line
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f' || c == '\0';
+}
+
+// the next word of a line from pos, it is [begin, pos) when true is returned
+inline bool nextWord(const std::string& line, size_t& pos, size_t& begin) {
+    while (pos < line.size() && isSpace(line[pos])) {
+        pos++;
+    }
+    begin = pos;
+    while (pos < line.size() && !isSpace(line[pos])) {
+        pos++;
+    }
+    return pos > begin;
+}
 }
 
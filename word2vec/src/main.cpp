@@ -12,6 +12,8 @@
 
 #include "args.h"
 #include "fasttext.h"
+#include "jobs.h"
+#include "dedup.h"
 
 
 void printUsage() {
@@ -22,6 +24,11 @@ void printUsage() {
 		<< "  cbow  ------ train word embedding by use cbow model\n"
 		<< "  subword   ------ train word embedding by use subword(fastetxt skipgram)  model\n"
 		<< "  substoke   ------ train chinses character embedding by use substoke(cw2vec) model\n"
+		<< "  compile-feature   ------ compile the stroke feature file to a binary lexicon for -infeature\n"
+		<< "  print-word-vectors   ------ print vectors of words read from stdin, also out of vocabulary words\n"
+		<< "  analogy   ------ accuracy of a model on \"a b c d\" analogy questions by 3CosAdd and 3CosMul\n"
+		<< "  multi   ------ train the models of a job spec on one pass over the corpus\n"
+		<< "  dedup   ------ write the corpus without its exact and near duplicate lines\n"
 		<< std::endl;
 }
  
@@ -32,9 +39,108 @@ void train(const std::vector<std::string> args) {
 	FastText fasttext;
 	fasttext.train(a);
 	fasttext.saveVectors();
+	fasttext.saveModel();
+	if (a.trace != "") {
+		Trace::write(a.trace, a.rank);
+	}
 	std::cout << "Train Embedding By Using [" + args[1] + "] model have Finished" << std::endl;
 }
 
+void printWordVectors(const std::vector<std::string> args) {
+	if (args.size() < 3) {
+		std::cerr << "usage: word2vec print-word-vectors <model.bin> [-thread N] [-cacheSize N] < words.txt" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	// parse the arguments after the model path
+	std::vector<std::string> rest(args.begin(), args.begin() + 2);
+	rest.insert(rest.end(), args.begin() + 3, args.end());
+	Args a = Args();
+	a.parseArgs(rest);
+	FastText fasttext;
+	fasttext.loadModel(a, args[2]);
+	fasttext.printWordVectors(std::cin, std::cout);
+}
+
+void analogy(const std::vector<std::string> args) {
+	if (args.size() < 4) {
+		std::cerr << "usage: word2vec analogy <model.bin> <questions.txt> [-thread N]" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	// parse the arguments after the model and questions paths
+	std::vector<std::string> rest(args.begin(), args.begin() + 2);
+	rest.insert(rest.end(), args.begin() + 4, args.end());
+	Args a = Args();
+	a.parseArgs(rest);
+	FastText fasttext;
+	fasttext.loadModel(a, args[2]);
+	std::ifstream ifs(args[3]);
+	if (!ifs.is_open()) {
+		throw std::invalid_argument(args[3] + " cannot be opened for analogy.");
+	}
+	std::vector<std::string> words;
+	std::shared_ptr<Matrix> vectors = fasttext.getWordVectors(words);
+	Analogy analogy(std::make_shared<Args>(a), words, vectors);
+	analogy.readQuestions(ifs);
+	ifs.close();
+	analogy.evaluate(std::cout);
+}
+
+void multi(const std::vector<std::string> args) {
+	if (args.size() < 3) {
+		std::cerr << "usage: word2vec multi <jobs.txt> [shared args], a job per line: <model> [args]" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	std::vector<std::string> shared(args.begin() + 3, args.end());
+	Jobs jobs;
+	jobs.parse(args[2], shared);
+	jobs.run();
+	if (jobs.job(0).trace != "") {
+		Trace::write(jobs.job(0).trace, jobs.job(0).rank);
+	}
+	std::cout << "Train Embedding By Using the job spec " << args[2] << " have Finished" << std::endl;
+}
+
+void dedup(const std::vector<std::string> args) {
+	Args a = Args();
+	a.parseArgs(args);
+	if (a.input == "" || a.output == "" || a.input == "-") {
+		std::cerr << "usage: word2vec dedup -input <corpus> -output <corpus.txt> [-thread N] [-dedupBands N] [-dedupMemory MB]" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	Corpus ifs(a.input);
+	if (!ifs.is_open()) {
+		throw std::invalid_argument(a.input + " cannot be opened for dedup.");
+	}
+	std::ofstream ofs(a.output);
+	if (!ofs.is_open()) {
+		throw std::invalid_argument(a.output + " cannot be opened for saving the corpus.");
+	}
+	Dedup dedup(std::make_shared<Args>(a));
+	dedup.filter(ifs, ofs);
+	ofs.close();
+	ifs.close();
+	dedup.printInfo();
+	if (a.trace != "") {
+		Trace::write(a.trace, a.rank);
+	}
+}
+
+void compileFeature(const std::vector<std::string> args) {
+	if (args.size() < 4) {
+		std::cerr << "usage: word2vec compile-feature <feature.txt> <feature.lex>" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	StrokeLexicon lexicon;
+	lexicon.load(args[2]);
+	std::ofstream ofs(args[3], std::ofstream::binary);
+	if (!ofs.is_open()) {
+		throw std::invalid_argument(args[3] + " cannot be opened for saving stroke lexicon.");
+	}
+	lexicon.save(ofs);
+	ofs.close();
+	std::cout << "Compiled " << lexicon.size() << " characters to " << args[3] << std::endl;
+}
+
 int main(int argc, char** argv){
 	std::vector<std::string> args(argv, argv + argc);
 	if (args.size() < 2) {
@@ -43,6 +149,26 @@ int main(int argc, char** argv){
 		exit(EXIT_FAILURE);
 	}
 	std::string command(args[1]);
+	if (command == "compile-feature") {
+		compileFeature(args);
+		return 0;
+	}
+	if (command == "print-word-vectors") {
+		printWordVectors(args);
+		return 0;
+	}
+	if (command == "analogy") {
+		analogy(args);
+		return 0;
+	}
+	if (command == "multi") {
+		multi(args);
+		return 0;
+	}
+	if (command == "dedup") {
+		dedup(args);
+		return 0;
+	}
 	if (command != "skipgram" && command != "cbow" && command != "subword" && command != "substoke") {
 		std::cerr << "\nError command: " + command << std::endl;
 		printUsage();